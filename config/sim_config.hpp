@@ -7,6 +7,7 @@
 #include <filesystem>
 #include <iostream>
 #include <string>
+#include <cstdint>
 
 //-----------------------------------------------------------------------------------------
 
@@ -25,6 +26,19 @@ class sim_config_t final {
         size_t initial_reg_val {0};
         size_t max_cycles {0};
         size_t jit_bound {10};
+        size_t jit_inline_size {16};
+        size_t trace_threshold {64};
+        bool   native_libcalls {0};
+        size_t itlb_entries {64};
+        size_t itlb_ways {4};
+        size_t dtlb_entries {64};
+        size_t dtlb_ways {4};
+        std::string tlb_replacement {"lru"};
+        size_t memory_size {16ULL << 30};       // guest RAM, bytes; K/M/G suffixes allowed
+        std::string memory_hugepages {"off"};   // off | madvise | hugetlb
+
+        // The stack sits right below StackBottom (machine.hpp)
+        static constexpr size_t min_memory_size = 16ULL << 20;
 
     public:
         sim_config_t() {};
@@ -71,8 +85,74 @@ class sim_config_t final {
                     std::string str = data.substr(strlen("jit_bound="));
                     jit_bound = std::stoll(str);
                 }
+                else if (std::string::npos != (pos = data.find("jit_inline_size="))) {
+                    std::string str = data.substr(strlen("jit_inline_size="));
+                    jit_inline_size = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("trace_threshold="))) {
+                    std::string str = data.substr(strlen("trace_threshold="));
+                    trace_threshold = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("native_libcalls="))) {
+                    std::string str = data.substr(strlen("native_libcalls="));
+                    native_libcalls = std::stoi(str.c_str());
+                }
+                else if (std::string::npos != (pos = data.find("itlb_entries="))) {
+                    std::string str = data.substr(strlen("itlb_entries="));
+                    itlb_entries = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("itlb_ways="))) {
+                    std::string str = data.substr(strlen("itlb_ways="));
+                    itlb_ways = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("dtlb_entries="))) {
+                    std::string str = data.substr(strlen("dtlb_entries="));
+                    dtlb_entries = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("dtlb_ways="))) {
+                    std::string str = data.substr(strlen("dtlb_ways="));
+                    dtlb_ways = std::stoll(str);
+                }
+                else if (std::string::npos != (pos = data.find("tlb_replacement="))) {
+                    tlb_replacement = data.substr(strlen("tlb_replacement="));
+                }
+                else if (std::string::npos != (pos = data.find("memory_size="))) {
+                    std::string str = data.substr(strlen("memory_size="));
+                    memory_size = parse_memory_size(str);
+                }
+                else if (std::string::npos != (pos = data.find("memory_hugepages="))) {
+                    memory_hugepages = data.substr(strlen("memory_hugepages="));
+                }
             }
             config_data.close();
         }
 
+    private:
+        // Bytes, or a count of K, M or G
+        static size_t parse_memory_size(const std::string& str) {
+            size_t unit = 0;
+            size_t size = std::stoull(str, &unit);
+            std::string suffix = str.substr(unit);
+            suffix.erase(suffix.find_last_not_of(" \t\r") + 1);
+
+            unsigned shift = 0;
+            if (suffix == "K") {
+                shift = 10;
+            } else if (suffix == "M") {
+                shift = 20;
+            } else if (suffix == "G") {
+                shift = 30;
+            } else if (!suffix.empty()) {
+                throw std::runtime_error("memory_size: unknown suffix '" + suffix + "', use K, M or G");
+            }
+            if (size > (SIZE_MAX >> shift)) {
+                throw std::runtime_error("memory_size: " + str + " is too large");
+            }
+            size <<= shift;
+            if (size < min_memory_size) {
+                throw std::runtime_error("memory_size: " + str + " is below the 16M the stack needs");
+            }
+            return size;
+        }
+
 };
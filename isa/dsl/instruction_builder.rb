@@ -29,7 +29,8 @@ module SimInfra
                 dst = f if [:rd].include?(f.name)
             }
             scope.instance_eval block
-            scope.stmt(:setreg, [dst, dst.name]) if dst
+            # the decoder leaves rd unset when the code never names it
+            scope.stmt(:setreg, [dst, dst.name]) if dst && block =~ /\brd\b/
         end
     end
 
@@ -145,7 +145,9 @@ class DecoderGenerator
 
   def generate_field_extraction(instr_name, instr_data)
     fields = []
-    fields << "result.rd = get_rd(instruction);" if instr_data['code'].include?('rd')
+    # Formats with an rd field always decode it: passes over decoded code
+    # treat them as writing rd, so it has to name a real register
+    fields << "result.rd = get_rd(instruction);" if instr_data['code'].include?('rd') || %w[R I U J].include?(instr_data['format'])
     fields << "result.rs1 = get_rs1(instruction);" if instr_data['code'].include?('rs1')
     fields << "result.rs2 = get_rs2(instruction);" if instr_data['code'].include?('rs2')
     case instr_data['format']
@@ -210,28 +210,74 @@ class ExecuterGenerator
     executers.join("\n\n")
   end
 
-  def generate_cpp_from_ir(scope, indent = "    ")
+  # Statements that only compute the variable in their first operand
+  PURE_STMTS = [:getreg, :getimm, :getpc, :new_const, :let,
+                :add, :sub, :bitand, :bitor, :bitxor, :shl, :srl, :sra,
+                :eq, :neq, :lt, :gt, :ltu, :gtu,
+                :addw, :subw, :shl_w, :srl_w, :sra_w].freeze
+
+  def generate_cpp_from_ir(scope, indent = "    ", live = live_vars(scope.tree))
     code_lines = []
-    declarations = collect_declarations(scope.tree)
+    declarations = collect_declarations(scope.tree, live)
     code_lines += declarations.map { |decl| "#{indent}#{decl}" }
 
     scope.tree.each do |stmt|
-      code_lines << translate_stmt(stmt, indent)
+      next if PURE_STMTS.include?(stmt.name) && !live.include?(defined_var(stmt))
+      code_lines << (stmt.name == :if_expr ? translate_if(stmt, indent, live) : translate_stmt(stmt, indent))
     end
     code_lines.compact.join("\n")
   end
 
-  def collect_declarations(tree)
+  def collect_declarations(tree, live)
     vars = Set.new
     tree.each do |stmt|
       if stmt.name == :new_var
         var = stmt.oprnds[0]
-        vars.add("uint64_t #{var.name}_val;") if var.type == :i32
+        vars.add("uint64_t #{var.name}_val;") if var.type == :i32 && live.include?(var.name)
       end
     end
     vars.to_a
   end
 
+  # Names of the variables some effect depends on; a pure statement whose
+  # result is not among them is dropped along with its operands' reads
+  def live_vars(tree)
+    live = Set.new
+    loop do
+      before = live.size
+      collect_uses(tree, live)
+      return live if live.size == before
+    end
+  end
+
+  def collect_uses(tree, live)
+    tree.each do |stmt|
+      case stmt.name
+      when :new_var, :sfence_vma then next
+      when :setreg then live << stmt.oprnds[1]
+      when :if_expr
+        live << stmt.oprnds[0].name
+        collect_uses(stmt.oprnds[1].tree, live)
+      else
+        pure = PURE_STMTS.include?(stmt.name)
+        next if pure && !live.include?(defined_var(stmt))
+        (pure ? stmt.oprnds.drop(1) : stmt.oprnds).each do |o|
+          live << o.name if o.is_a?(SimInfra::Var) || o.is_a?(SimInfra::Constant)
+        end
+      end
+    end
+  end
+
+  def defined_var(stmt)
+    stmt.name == :getreg ? stmt.oprnds[0] : stmt.oprnds[0].name
+  end
+
+  def translate_if(stmt, indent, live)
+    cond = get_var_name(stmt.oprnds[0])
+    body_code = generate_cpp_from_ir(stmt.oprnds[1], indent + "    ", live)
+    "#{indent}if (#{cond}) {\n#{body_code}\n#{indent}}"
+  end
+
   def translate_stmt(stmt, indent)
     case stmt.name
     when :new_var then nil  # Handled in declarations
@@ -266,14 +312,12 @@ class ExecuterGenerator
       size_bytes = {byte: 1, half: 2, word: 4}[size]
       "#{indent}hart.memory_write(#{addr}, #{src}, #{size_bytes});"
     when :setpc then "#{indent}hart.set_next_pc(#{get_var_name(stmt.oprnds[0])});"
-    when :if_expr
-      cond = get_var_name(stmt.oprnds[0])
-      body_code = generate_cpp_from_ir(stmt.oprnds[1], indent + "    ")
-      "#{indent}if (#{cond}) {\n#{body_code}\n#{indent}}"
     when :let then "#{indent}#{get_var_name(stmt.oprnds[0])} = #{get_var_name(stmt.oprnds[1])};"
     when :ecall then "#{indent}hart.do_ecall();"
     when :ebreak then "#{indent}hart.set_halt(true);"
     when :setcsr then "#{indent}hart.set_csr(imm_val, rs1_val);"
+    # x0 operands widen the fence, so it takes register numbers, not values
+    when :sfence_vma then "#{indent}hart.sfence_vma(instr.#{stmt.oprnds[0]}, instr.#{stmt.oprnds[1]});"
     else "#{indent}// Unsupported: #{stmt.name}"
     end
   end
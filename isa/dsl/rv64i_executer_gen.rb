@@ -29,14 +29,18 @@ class ExecuterGenerator
       "#{indent}#{dest} = static_cast<uint64_t>(static_cast<int64_t>(res));"
 
     when :load_from_mem
+      # Fixed-size access; a signed load goes through the signed type of its
+      # width so the conversion to uint64_t sign-extends
       size = stmt.attrs[:size] || :word
       size_bytes = {byte: 1, half: 2, word: 4, double: 8}[size]
-      "#{indent}#{get_var_name(stmt.oprnds[0])} = hart.load(#{get_var_name(stmt.oprnds[1])}, #{size_bytes});"
+      load = "hart.load<#{size_bytes}>(#{get_var_name(stmt.oprnds[1])})"
+      load = "static_cast<int#{size_bytes * 8}_t>(#{load})" if stmt.attrs[:sign] == :signed && size_bytes < 8
+      "#{indent}#{get_var_name(stmt.oprnds[0])} = #{load};"
 
     when :store_to_mem
       size = stmt.attrs[:size] || :word
       size_bytes = {byte: 1, half: 2, word: 4, double: 8}[size]
-      "#{indent}hart.store(#{get_var_name(stmt.oprnds[0])}, #{get_var_name(stmt.oprnds[1])}, #{size_bytes});"
+      "#{indent}hart.store<#{size_bytes}>(#{get_var_name(stmt.oprnds[0])}, static_cast<uint#{size_bytes * 8}_t>(#{get_var_name(stmt.oprnds[1])}));"
 
     when :ecall
       "#{indent}hart.do_ecall();"
@@ -121,13 +121,15 @@ module SimInfra
         def ge(a, b); neq(lt(a, b), 1); end
 
         # memory
-        def memory_ld(address, size=:word, sign=:signed); memoryLoad(address, :load_from_mem, size) end
+        def memory_ld(address, size=:word, sign=:signed); memoryLoad(address, :load_from_mem, size, sign) end
         def memory_st(address, src, size=:word); memoryStore(address, src, :store_to_mem, size) end
         # pc
         def pc(); pcHandler end
         def set_pc(value); setPc(value, :setpc) end
         # Control Register
         def set_csr(value, rs1); setCsr(value, rs1, :setcsr) end
+        # Address translation fence over the registers named by vaddr and asid
+        def sfence_vma(vaddr, asid); stmt :sfence_vma, [vaddr.name, asid.name] end
 
         # imm
         def imm(); immHandler end
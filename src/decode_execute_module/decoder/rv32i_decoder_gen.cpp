@@ -624,12 +624,25 @@ DecodedInstruction decode_csrw(uint32_t instruction) {
     DecodedInstruction result;
     result.opcode = InstructionOpcode::CSRW;
     result.format = InstructionFormat::I;
-    result.rs1 = get_rs1(instruction);
+    result.rd = get_rd(instruction);
+                result.rs1 = get_rs1(instruction);
                 result.imm = get_imm_i(instruction);
 
     return result;
 }
 
+DecodedInstruction decode_sfence_vma(uint32_t instruction) {
+    DecodedInstruction result;
+    result.opcode = InstructionOpcode::SFENCE_VMA;
+    result.format = InstructionFormat::R;
+    result.rd = get_rd(instruction);
+                result.rs1 = get_rs1(instruction);
+                result.rs2 = get_rs2(instruction);
+                result.imm = 0;
+
+    return result;
+}
+
 
 DecodedInstruction decode(uint32_t instruction) {
     DecodedInstruction result;
@@ -827,7 +840,10 @@ DecodedInstruction decode(uint32_t instruction) {
 		case 115:
 			switch (get_funct3(instruction)) {
 				case 0:
-					result = decode_ecall(instruction);
+					switch (get_funct7(instruction)) {
+						case 0: result = decode_ecall(instruction); break;
+						case 9: result = decode_sfence_vma(instruction); break;
+					}
 					break;
 				case 1:
 					result = decode_csrw(instruction);
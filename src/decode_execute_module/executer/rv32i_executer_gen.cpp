@@ -58,7 +58,7 @@ void execute_lb(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp0_val = rs1_val + imm_val;
-    _tmp1_val = hart.load(_tmp0_val, 1);
+    _tmp1_val = static_cast<int8_t>(hart.load<1>(_tmp0_val));
     rd_val = _tmp1_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -119,7 +119,7 @@ void execute_lh(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp2_val = rs1_val + imm_val;
-    _tmp3_val = hart.load(_tmp2_val, 2);
+    _tmp3_val = static_cast<int16_t>(hart.load<2>(_tmp2_val));
     rd_val = _tmp3_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -180,7 +180,7 @@ void execute_lw(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp4_val = rs1_val + imm_val;
-    _tmp5_val = hart.load(_tmp4_val, 4);
+    _tmp5_val = static_cast<int32_t>(hart.load<4>(_tmp4_val));
     rd_val = _tmp5_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -241,7 +241,7 @@ void execute_ld(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp6_val = rs1_val + imm_val;
-    _tmp7_val = hart.load(_tmp6_val, 8);
+    _tmp7_val = hart.load<8>(_tmp6_val);
     rd_val = _tmp7_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -302,7 +302,7 @@ void execute_lbu(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp8_val = rs1_val + imm_val;
-    _tmp9_val = hart.load(_tmp8_val, 1);
+    _tmp9_val = hart.load<1>(_tmp8_val);
     rd_val = _tmp9_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -363,7 +363,7 @@ void execute_lhu(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp10_val = rs1_val + imm_val;
-    _tmp11_val = hart.load(_tmp10_val, 2);
+    _tmp11_val = hart.load<2>(_tmp10_val);
     rd_val = _tmp11_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -424,7 +424,7 @@ void execute_lwu(const DecodedInstruction &instr, Hart& hart) {
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp12_val = rs1_val + imm_val;
-    _tmp13_val = hart.load(_tmp12_val, 4);
+    _tmp13_val = hart.load<4>(_tmp12_val);
     rd_val = _tmp13_val;
     hart.set_reg(instr.rd, rd_val);
   
@@ -485,7 +485,7 @@ void execute_sb(const DecodedInstruction &instr, Hart& hart) {
     rs2_val = hart.get_reg(instr.rs2);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp14_val = rs1_val + imm_val;
-    hart.store(_tmp14_val, rs2_val, 1);
+    hart.store<1>(_tmp14_val, static_cast<uint8_t>(rs2_val));
   
   #ifdef ENABLE_MODULES
   {
@@ -544,7 +544,7 @@ void execute_sh(const DecodedInstruction &instr, Hart& hart) {
     rs2_val = hart.get_reg(instr.rs2);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp15_val = rs1_val + imm_val;
-    hart.store(_tmp15_val, rs2_val, 2);
+    hart.store<2>(_tmp15_val, static_cast<uint16_t>(rs2_val));
   
   #ifdef ENABLE_MODULES
   {
@@ -603,7 +603,7 @@ void execute_sw(const DecodedInstruction &instr, Hart& hart) {
     rs2_val = hart.get_reg(instr.rs2);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp16_val = rs1_val + imm_val;
-    hart.store(_tmp16_val, rs2_val, 4);
+    hart.store<4>(_tmp16_val, static_cast<uint32_t>(rs2_val));
   
   #ifdef ENABLE_MODULES
   {
@@ -662,7 +662,7 @@ void execute_sd(const DecodedInstruction &instr, Hart& hart) {
     rs2_val = hart.get_reg(instr.rs2);
     imm_val = static_cast<uint64_t>(instr.imm);
     _tmp17_val = rs1_val + imm_val;
-    hart.store(_tmp17_val, rs2_val, 8);
+    hart.store<8>(_tmp17_val, static_cast<uint64_t>(rs2_val));
   
   #ifdef ENABLE_MODULES
   {
@@ -3093,13 +3093,11 @@ void execute_csrw(const DecodedInstruction &instr, Hart& hart) {
   #endif
 
   // Generated from IR
-      uint64_t rd_val;
-    uint64_t rs1_val;
+      uint64_t rs1_val;
     uint64_t imm_val;
     rs1_val = hart.get_reg(instr.rs1);
     imm_val = static_cast<uint64_t>(instr.imm);
     hart.set_csr(imm_val, rs1_val);
-    hart.set_reg(instr.rd, rd_val);
   
   #ifdef ENABLE_MODULES
   {
@@ -3140,6 +3138,57 @@ void execute_csrw(const DecodedInstruction &instr, Hart& hart) {
 }
 
 
+void execute_sfence_vma(const DecodedInstruction &instr, Hart& hart) {
+  #ifdef ENABLE_MODULES
+  {
+    constexpr size_t __idx = static_cast<size_t>(InstructionOpcode::SFENCE_VMA);
+    auto __ph = pre_handlers_vec[__idx];
+    if (__ph) __ph(instr, hart);
+  }
+  #endif
+
+  // Generated from IR
+      hart.sfence_vma(instr.rs1, instr.rs2);
+  
+  #ifdef ENABLE_MODULES
+  {
+    constexpr size_t __idx = static_cast<size_t>(InstructionOpcode::SFENCE_VMA);
+    auto __ph = post_handlers_vec[__idx];
+
+    if (__ph) {
+      PostExecInfo __pei;
+      try {
+        __pei.read_reg1_val = hart.get_reg(instr.rs1);
+        __pei.read_reg1 = static_cast<int32_t>(instr.rs1);
+      } catch (...) {
+          __pei.read_reg1 = -1; // invalid
+          __pei.read_reg1_val = 0;
+      }
+
+      try {
+        __pei.read_reg2_val = hart.get_reg(instr.rs2);
+        __pei.read_reg2 = static_cast<int32_t>(instr.rs2);
+      } catch (...) {
+          __pei.read_reg2 = -1; // invalid
+          __pei.read_reg2_val = 0;
+      }
+
+      try {
+        __pei.dest_reg_val = hart.get_reg(instr.rd);
+        __pei.dest_reg = static_cast<int32_t>(instr.rd);
+      } catch (...) {
+          __pei.read_reg1 = -1; // invalid
+          __pei.read_reg1_val = 0;
+      }
+      __pei.imm_val = static_cast<uint64_t>(instr.imm);
+      __ph(instr, hart, __pei);
+    }
+
+  }
+  #endif
+}
+
+
 ExecFn execute(const DecodedInstruction &instr, Hart& hart) {
   switch (instr.opcode) {
     case InstructionOpcode::LB: execute_lb(instr, hart); return &execute_lb;
@@ -3193,6 +3242,7 @@ ExecFn execute(const DecodedInstruction &instr, Hart& hart) {
                 case InstructionOpcode::JAL: execute_jal(instr, hart); return &execute_jal;
                 case InstructionOpcode::ECALL: execute_ecall(instr, hart); return &execute_ecall;
                 case InstructionOpcode::CSRW: execute_csrw(instr, hart); return &execute_csrw;
+                case InstructionOpcode::SFENCE_VMA: execute_sfence_vma(instr, hart); return &execute_sfence_vma;
     default:
       hart.handle_exception(ExceptionCause::UnknowInstruction);
       return nullptr;
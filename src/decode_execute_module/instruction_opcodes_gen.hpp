@@ -51,6 +51,7 @@ enum class InstructionOpcode {
  JAL,
  ECALL,
  CSRW,
+ SFENCE_VMA,
     UNKNOWN
 };
 
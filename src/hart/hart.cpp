@@ -7,11 +7,15 @@
 #include "modules_api/callbacks.hpp"
 #endif
 
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <cmath>
+
+#include "jit/cfg.hpp"
 
 #ifdef DEBUG_EXECUTION
 static inline void debug_cout(const std::string& msg) {
@@ -31,7 +35,10 @@ Hart::Hart(MMU &mmu, sim_config_t& sim_conf) :
     csr_satp_(0), 
     pc_       (sim_conf.initial_pc), 
     th_code_  (sim_conf, this), 
-    max_cached_bb_size_(sim_conf.cached_bb_size) {
+    max_cached_bb_size_(sim_conf.cached_bb_size),
+    max_inline_size_(sim_conf.jit_inline_size),
+    trace_threshold_(sim_conf.trace_threshold),
+    native_libcalls_(sim_conf.native_libcalls) {
 
     regs_.fill(sim_conf.initial_reg_val);
 
@@ -60,7 +67,33 @@ void Hart::set_csr(uint16_t reg_num, reg_t value) {
     if (reg_num !=  0x180)
         throw std::runtime_error("Unsupported control register number in set_csr");
     
+    // Entries are tagged with the ASID, so switching to another address
+    // space needs no flush. Retargeting the one in use does: its old
+    // translations would still match.
+    const reg_t old_satp = csr_satp_;
     csr_satp_ = value;
+    drop_fetch_page();
+    if (satp_to_asid(value) == satp_to_asid(old_satp) && value != old_satp) {
+        mmu_.sfence_vma(std::nullopt, satp_to_asid(value));
+    }
+}
+
+void Hart::sfence_vma(uint8_t rs1, uint8_t rs2) {
+    // x0 in rs1 fences every address, x0 in rs2 every address space
+    std::optional<va_t> va;
+    std::optional<uint16_t> asid;
+    if (rs1 != 0) {
+        va = get_reg(rs1);
+    }
+    if (rs2 != 0) {
+        asid = static_cast<uint16_t>(get_reg(rs2));
+    }
+    sfence_vma(va, asid);
+}
+
+void Hart::sfence_vma(std::optional<va_t> va, std::optional<uint16_t> asid) {
+    mmu_.sfence_vma(va, asid);
+    drop_fetch_page();
 }
 
 Hart::reg_t Hart::get_csr(uint16_t reg_num) const {
@@ -85,6 +118,22 @@ uint64_t* Hart::get_instr_counter_ptr() {
     return &instr_counter_;
 }
 
+uint64_t* Hart::get_instr_deadline_ptr() {
+    return &instr_deadline_;
+}
+
+void Hart::set_instr_budget(uint64_t budget) {
+    if (budget == 0 || budget > UINT64_MAX - instr_counter_) {
+        instr_deadline_ = UINT64_MAX;
+        return;
+    }
+    instr_deadline_ = instr_counter_ + budget;
+}
+
+bool Hart::is_budget_exhausted() const {
+    return instr_counter_ >= instr_deadline_;
+}
+
 void Hart::set_pc(reg_t value) {
     pc_ = value;
 }
@@ -98,6 +147,7 @@ HartContext Hart::get_context_for_MMU() const {
             .root_table = satp_to_root_table(csr_satp_), 
             .mode = (csr_satp_ >> 60) & 0xF, // satp.MODE is bits 63:60
             .prv = prv_,
+            .asid = satp_to_asid(csr_satp_),
         };
 }
 
@@ -109,13 +159,17 @@ size_t Hart::get_memory_size() const {
     return mmu_.get_capacity();
 }
 
+std::pair<pa_t, pa_t> Hart::mmio_hull() const {
+    return {mmu_.bus().hull_lo(), mmu_.bus().hull_hi()};
+}
+
 bool Hart::is_paging_disabled() const {
     return ((csr_satp_ >> 60) & 0xF) == 0;
 }
 
 template<AccessType type>
-pa_t Hart::va_to_pa(va_t va) {
-    auto tr = mmu_.translate<type>(va, get_context_for_MMU());
+pa_t Hart::va_to_pa(va_t va, size_t size) {
+    auto tr = mmu_.translate<type>(va, get_context_for_MMU(), size);
 
     if (!tr.e.is_none()) {
         handle_exception(tr);
@@ -145,9 +199,44 @@ pa_t Hart::satp_to_root_table(const reg_t satp) const {
     return (satp & SATP_PPN_MASK) * PAGESIZE; 
 }
 
-reg_t Hart::load(reg_t va, int size) {
-    pa_t pa = va_to_pa<AccessType::Load>(va);
-    reg_t val = mmu_.mem_load(pa, size);
+uint16_t Hart::satp_to_asid(const reg_t satp) {
+    // satp.ASID is bits 59:44
+    return static_cast<uint16_t>((satp >> 44) & 0xFFFF);
+}
+
+// Accesses that hit the TLB (or run with paging off) go straight to the
+// host page; hooks need the physical address, so they take the long way.
+bool Hart::host_access_allowed() const {
+#ifdef ENABLE_MODULES
+    return !any_translate_callbacks_ && !any_mem_access_callbacks_;
+#else
+    return true;
+#endif
+}
+
+// Shortcuts that retire many guest instructions at once (native library
+// calls, idle loop fast-forward) skip every hook, so they stay off while
+// any module is listening.
+bool Hart::has_module_callbacks() const {
+#ifdef ENABLE_MODULES
+    return any_pre_callbacks_ || any_post_callbacks_ || any_block_start_callbacks_ ||
+           any_block_end_callbacks_ || any_mem_access_callbacks_ || any_translate_callbacks_;
+#else
+    return false;
+#endif
+}
+
+template<int N>
+mem_word_t<N> Hart::load(va_t va) {
+    if (host_access_allowed()) {
+        if (const uint8_t* host = mmu_.host_ptr<AccessType::Load>(va, N, get_context_for_MMU())) {
+            mem_word_t<N> val;
+            std::memcpy(&val, host, N);
+            return val;
+        }
+    }
+    pa_t pa = va_to_pa<AccessType::Load>(va, N);
+    mem_word_t<N> val = mmu_.mem_load<N>(pa);
 
 #ifdef ENABLE_MODULES
     if (any_mem_access_callbacks_) {
@@ -156,7 +245,7 @@ reg_t Hart::load(reg_t va, int size) {
             mai.type = AccessType::Load;
             mai.va = va;
             mai.pa = pa;
-            mai.size_bytes = size;
+            mai.size_bytes = N;
             mai.value = val;
             mai.e = Exception(ExceptionCause::None);
             for (const auto &entry : mem_access_callbacks_) {
@@ -169,15 +258,16 @@ reg_t Hart::load(reg_t va, int size) {
     return val;
 }
 
-uint32_t Hart::fetch(reg_t va) {
-    // TODO: add hook
-    return mmu_.mem_load(va_to_pa<AccessType::Fetch>(va), 4);
-}
-
-void Hart::store(reg_t va, reg_t value, int size) {
-    // std::cerr << "Hart::store called: va=0x" << std::hex << va << " value=0x" << value << " size=" << std::dec << size << std::endl;
-    pa_t pa = va_to_pa<AccessType::Store>(va);
-    mmu_.mem_store(pa, value, size);
+template<int N>
+void Hart::store(va_t va, mem_word_t<N> value) {
+    if (host_access_allowed()) {
+        if (uint8_t* host = mmu_.host_ptr<AccessType::Store>(va, N, get_context_for_MMU())) {
+            std::memcpy(host, &value, N);
+            return;
+        }
+    }
+    pa_t pa = va_to_pa<AccessType::Store>(va, N);
+    mmu_.mem_store<N>(pa, value);
 
 #ifdef ENABLE_MODULES
     if (any_mem_access_callbacks_) {
@@ -186,7 +276,7 @@ void Hart::store(reg_t va, reg_t value, int size) {
             mai.type = AccessType::Store;
             mai.va = va;
             mai.pa = pa;
-            mai.size_bytes = size;
+            mai.size_bytes = N;
             mai.value = value;
             mai.e = Exception(ExceptionCause::None);
             for (const auto &entry : mem_access_callbacks_) {
@@ -195,8 +285,59 @@ void Hart::store(reg_t va, reg_t value, int size) {
         }
     }
 #endif
+}
+
+template mem_word_t<1> Hart::load<1>(va_t);
+template mem_word_t<2> Hart::load<2>(va_t);
+template mem_word_t<4> Hart::load<4>(va_t);
+template mem_word_t<8> Hart::load<8>(va_t);
+template void Hart::store<1>(va_t, mem_word_t<1>);
+template void Hart::store<2>(va_t, mem_word_t<2>);
+template void Hart::store<4>(va_t, mem_word_t<4>);
+template void Hart::store<8>(va_t, mem_word_t<8>);
+
+reg_t Hart::load(reg_t va, int size) {
+    switch (size) {
+        case 1:  return load<1>(va);
+        case 2:  return load<2>(va);
+        case 4:  return load<4>(va);
+        default: return load<8>(va);
+    }
+}
+
+uint32_t Hart::fetch(reg_t va) {
+    // TODO: add hook
+    // Instruction words come straight from the host copy of the current
+    // code page until the pc leaves it or the translation may have changed
+    const reg_t page = va & ~(PAGESIZE - 1);
+    if (host_access_allowed()) {
+        if (page != fetch_page_va_) {
+            uint8_t* host = mmu_.host_ptr<AccessType::Fetch>(page, PAGESIZE, get_context_for_MMU());
+            if (host == nullptr) {
+                return mmu_.mem_load<4>(va_to_pa<AccessType::Fetch>(va, 4));
+            }
+            fetch_page_va_ = page;
+            fetch_page_host_ = host;
+        }
+        uint32_t word;
+        std::memcpy(&word, fetch_page_host_ + (va - page), 4);
+        return word;
+    }
+    return mmu_.mem_load<4>(va_to_pa<AccessType::Fetch>(va, 4));
+}
+
+void Hart::drop_fetch_page() {
+    fetch_page_va_ = no_fetch_page;
+    fetch_page_host_ = nullptr;
+}
 
-    return;
+void Hart::store(reg_t va, reg_t value, int size) {
+    switch (size) {
+        case 1:  store<1>(va, static_cast<uint8_t>(value)); break;
+        case 2:  store<2>(va, static_cast<uint16_t>(value)); break;
+        case 4:  store<4>(va, static_cast<uint32_t>(value)); break;
+        default: store<8>(va, value); break;
+    }
 }
 
 void Hart::handle_exception(const Exception e) {
@@ -220,6 +361,10 @@ void Hart::set_exec_ranges(std::vector<CodeRange> ranges) {
     exec_ranges_ = std::move(ranges);
 }
 
+void Hart::set_rodata_ranges(std::vector<CodeRange> ranges) {
+    rodata_ranges_ = std::move(ranges);
+}
+
 bool Hart::predecode_and_jit_if_small() {
     if (!th_code_.is_jit_enabled() || exec_ranges_.empty()) {
         return false;
@@ -274,6 +419,10 @@ bool Hart::predecode_and_jit_if_small() {
     return true;
 }
 
+void Hart::write_jit_exit_report(std::ostream& out) const {
+    th_code_.write_exit_report(out);
+}
+
 bool Hart::ensure_jit_function(uint64_t entry_pc) {
     if (!th_code_.is_jit_enabled()) {
         return false;
@@ -298,7 +447,7 @@ void Hart::execute_jitted_function(uint64_t entry_pc) {
 }
 
 void Hart::run_until_pc(uint64_t target_pc) {
-    while (!halt_ && pc_ != target_pc) {
+    while (!halt_ && pc_ != target_pc && !is_budget_exhausted()) {
         step();
     }
 }
@@ -311,6 +460,8 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
     std::unordered_map<uint64_t, DecodedInstruction> instrs_by_pc;
     std::unordered_set<uint64_t> visited;
     std::vector<uint64_t> worklist;
+    std::unordered_map<uint64_t, jit::JumpTable> jump_tables;
+    std::unordered_map<uint64_t, riscv_sim::Block::InlineBody> inline_callees;
 
     worklist.push_back(entry_pc);
 
@@ -323,6 +474,14 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
         }
         visited.insert(pc);
 
+        // Idle loops are left to the dispatcher, which skips them
+        if (find_idle_loop(pc) != nullptr) {
+            if (pc == entry_pc) {
+                return false;
+            }
+            continue;
+        }
+
         uint32_t raw_instr = static_cast<uint32_t>(fetch(pc));
         DecodedInstruction dinstr = riscv_sim::decoder::decode(raw_instr);
         instrs_by_pc.emplace(pc, dinstr);
@@ -334,12 +493,18 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
         if (dinstr.opcode == InstructionOpcode::JAL) {
             uint64_t target = pc + static_cast<int64_t>(dinstr.imm);
             if (dinstr.rd != 0) {
-                if (is_exec_pc(target)) {
+                if (is_exec_pc(target) && !is_native_call(target)) {
                     call_targets.push_back(target);
+                    if (inline_callees.count(target) == 0) {
+                        if (auto body = find_inline_callee(target)) {
+                            inline_callees.emplace(target, std::move(*body));
+                        }
+                    }
                 }
                 worklist.push_back(pc + 4);
             } else {
-                if (is_exec_pc(target)) {
+                // A tail call into a native routine leaves the block
+                if (is_exec_pc(target) && !is_native_call(target)) {
                     worklist.push_back(target);
                 }
             }
@@ -353,6 +518,9 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
             }
             if (dinstr.rd != 0) {
                 worklist.push_back(pc + 4);
+            } else if (auto table = find_jump_table(pc)) {
+                worklist.insert(worklist.end(), table->targets.begin(), table->targets.end());
+                jump_tables.emplace(pc, std::move(*table));
             }
             continue;
         }
@@ -373,31 +541,50 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
         return false;
     }
 
+    // A table is only trusted if nothing else in the function jumps into the
+    // middle of its bound check and dispatch sequence
+    std::unordered_set<uint64_t> entered{entry_pc};
+    for (const auto& [pc, instr] : instrs_by_pc) {
+        if (instr.format == InstructionFormat::B || instr.opcode == InstructionOpcode::JAL) {
+            entered.insert(pc + static_cast<int64_t>(instr.imm));
+        }
+        if ((instr.opcode == InstructionOpcode::JAL || instr.opcode == InstructionOpcode::JALR) &&
+            instr.rd != 0) {
+            entered.insert(pc + 4);
+        }
+    }
+    for (const auto& [pc, table] : jump_tables) {
+        entered.insert(table.targets.begin(), table.targets.end());
+    }
+    blk.jump_tables.clear();
+    for (const auto& [pc, table] : jump_tables) {
+        bool sound = true;
+        for (uint64_t p = table.first_pc + 4; p <= pc; p += 4) {
+            sound = sound && entered.count(p) == 0;
+        }
+        if (sound) {
+            blk.jump_tables.emplace(pc, table.targets);
+        }
+    }
+
     std::vector<uint64_t> pcs;
+    std::vector<DecodedInstruction> instrs;
     pcs.reserve(instrs_by_pc.size());
+    instrs.reserve(instrs_by_pc.size());
     for (const auto& kv : instrs_by_pc) {
         pcs.push_back(kv.first);
+        instrs.push_back(kv.second);
     }
-    std::sort(pcs.begin(), pcs.end());
 
-    auto start_it = std::find(pcs.begin(), pcs.end(), entry_pc);
-    if (start_it == pcs.end()) {
+    std::vector<uint64_t> ordered = layout_function_block(pcs, instrs, entry_pc, blk.jump_tables);
+    if (ordered.size() != pcs.size() || ordered.front() != entry_pc) {
         return false;
     }
 
-    std::vector<uint64_t> ordered;
-    ordered.reserve(pcs.size());
-    ordered.push_back(entry_pc);
-    for (auto it = std::next(start_it); it != pcs.end(); ++it) {
-        ordered.push_back(*it);
-    }
-    for (auto it = pcs.begin(); it != start_it; ++it) {
-        ordered.push_back(*it);
-    }
-
     blk.start_pc = static_cast<uint32_t>(entry_pc);
     blk.valid = true;
     blk.is_function_block = true;
+    blk.inline_callees = std::move(inline_callees);
     blk.instrs.clear();
     blk.exec_fns.clear();
     blk.instr_pcs.clear();
@@ -412,6 +599,136 @@ bool Hart::build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::v
     return true;
 }
 
+std::vector<uint64_t> Hart::layout_function_block(const std::vector<uint64_t>& pcs,
+                                                  const std::vector<DecodedInstruction>& instrs,
+                                                  uint64_t entry_pc,
+                                                  const jit::JumpTargets& jump_tables) const {
+    const jit::FunctionCfg cfg(pcs, instrs, entry_pc, &jump_tables);
+    const auto& nodes = cfg.nodes();
+
+    // Estimated edge frequency: each enclosing loop is assumed to run ten
+    // times, scaled by the probability of leaving from through this edge
+    auto edge_weight = [&](size_t from, size_t to) -> double {
+        const double freq = std::pow(10.0, std::min<uint32_t>(cfg.loop_depth(from), 6));
+        const uint64_t last_pc = nodes[from].pcs.back();
+        const DecodedInstruction& last = cfg.instr_at(last_pc);
+        if (last.format != InstructionFormat::B || nodes[from].succs.size() < 2) {
+            return freq;
+        }
+        const uint64_t target_pc = last_pc + static_cast<int64_t>(last.imm);
+        // Loops are taken, forward branches mostly not
+        const double p_taken = (target_pc <= last_pc) ? 0.9 : 0.4;
+        return freq * (nodes[to].start_pc == target_pc ? p_taken : 1.0 - p_taken);
+    };
+
+    // Cold: program exits
+    std::vector<bool> cold(nodes.size(), false);
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        for (auto pc : nodes[n].pcs) {
+            if (cfg.instr_at(pc).opcode == InstructionOpcode::ECALL) {
+                cold[n] = true;
+            }
+        }
+    }
+
+    std::vector<uint64_t> ordered;
+    ordered.reserve(pcs.size());
+    for (auto n : cfg.layout(edge_weight, cold)) {
+        ordered.insert(ordered.end(), nodes[n].pcs.begin(), nodes[n].pcs.end());
+    }
+    return ordered;
+}
+
+// A callee can be compiled into its call sites when it is a leaf of at most
+// max_inline_size_ instructions: no calls, ecalls, csr writes or indirect
+// jumps other than ret, and ra left untouched so every ret goes back to the
+// call site.
+std::optional<riscv_sim::Block::InlineBody> Hart::find_inline_callee(uint64_t entry_pc) {
+    std::unordered_map<uint64_t, DecodedInstruction> instrs_by_pc;
+    std::vector<uint64_t> worklist{entry_pc};
+
+    while (!worklist.empty()) {
+        uint64_t pc = worklist.back();
+        worklist.pop_back();
+
+        if (instrs_by_pc.count(pc) != 0) {
+            continue;
+        }
+        if (!is_exec_pc(pc) || instrs_by_pc.size() >= max_inline_size_ || find_idle_loop(pc) != nullptr) {
+            return std::nullopt;
+        }
+        DecodedInstruction dinstr = riscv_sim::decoder::decode(static_cast<uint32_t>(fetch(pc)));
+        instrs_by_pc.emplace(pc, dinstr);
+
+        const bool writes_rd = dinstr.format == InstructionFormat::R || dinstr.format == InstructionFormat::I ||
+                               dinstr.format == InstructionFormat::U || dinstr.format == InstructionFormat::J;
+        if (writes_rd && dinstr.rd == 1) {
+            return std::nullopt;
+        }
+        switch (dinstr.opcode) {
+            case InstructionOpcode::ECALL:
+            case InstructionOpcode::CSRW:
+            case InstructionOpcode::SFENCE_VMA:
+            case InstructionOpcode::UNKNOWN:
+                return std::nullopt;
+            case InstructionOpcode::JALR:
+                if (dinstr.rd != 0 || dinstr.rs1 != 1 || dinstr.imm != 0) {
+                    return std::nullopt;
+                }
+                continue;
+            case InstructionOpcode::JAL:
+                if (dinstr.rd != 0) {
+                    return std::nullopt;
+                }
+                worklist.push_back(pc + static_cast<int64_t>(dinstr.imm));
+                continue;
+            default:
+                break;
+        }
+        if (dinstr.format == InstructionFormat::B) {
+            worklist.push_back(pc + static_cast<int64_t>(dinstr.imm));
+        }
+        worklist.push_back(pc + 4);
+    }
+
+    riscv_sim::Block::InlineBody body;
+    for (const auto& kv : instrs_by_pc) {
+        body.pcs.push_back(kv.first);
+    }
+    std::sort(body.pcs.begin(), body.pcs.end());
+    std::rotate(body.pcs.begin(), std::find(body.pcs.begin(), body.pcs.end(), entry_pc), body.pcs.end());
+    for (auto pc : body.pcs) {
+        body.instrs.push_back(instrs_by_pc.at(pc));
+    }
+    return body;
+}
+
+std::optional<jit::JumpTable> Hart::find_jump_table(uint64_t jalr_pc) {
+    auto decode = [&](uint64_t pc) -> std::optional<DecodedInstruction> {
+        if (!is_exec_pc(pc)) {
+            return std::nullopt;
+        }
+        return riscv_sim::decoder::decode(static_cast<uint32_t>(fetch(pc)));
+    };
+    auto read = [&](uint64_t addr, int size) -> std::optional<uint64_t> {
+        if (!is_rodata(addr, size)) {
+            return std::nullopt;
+        }
+        return load(addr, size);
+    };
+    auto is_code = [&](uint64_t pc) { return is_exec_pc(pc); };
+    return jit::match_jump_table(jalr_pc, decode, read, is_code);
+}
+
+bool Hart::is_rodata(uint64_t addr, int size) const {
+    for (const auto& range : rodata_ranges_) {
+        if (addr >= range.start && addr + size <= range.end) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Hart::is_exec_pc(uint64_t pc) const {
     for (const auto& range : exec_ranges_) {
         if (pc >= range.start && pc < range.end) {
@@ -454,12 +771,14 @@ bool Hart::is_halt() const {
 uint64_t Hart::execute_cached_block(Hart& hart, riscv_sim::Block* blk) {
     if(blk->get_is_jitted()) {  
         // blk->jitted_bb.dump();
-        if (blk->is_function_block) {
+        if (blk->is_function_block || blk->is_trace) {
             uint64_t before = instr_counter_;
             blk->jitted_bb->execute();
             return instr_counter_ - before;
         }
+        // Plain blocks run to their end and do not count themselves
         blk->jitted_bb->execute();
+        instr_counter_ += blk->instrs.size();
         return blk->instrs.size();
     }
     uint64_t executed = 0;
@@ -525,6 +844,9 @@ uint64_t Hart::execute_cached_block(Hart& hart, riscv_sim::Block* blk) {
         }
 
         if (next_pc_ == blk->start_pc) {
+            if (instr_counter_ + executed >= instr_deadline_) {
+                break;
+            }
             debug_cout("Looping back to block start at PC: 0x" + std::to_string(pc_));
             idx = 0;
             continue;
@@ -537,9 +859,24 @@ uint64_t Hart::execute_cached_block(Hart& hart, riscv_sim::Block* blk) {
 }
 
 uint64_t Hart::step() {
+    if (!native_calls_.empty() && try_native_call(pc_)) {
+        return 1;
+    }
+    if (!idle_loops_.empty()) {
+        if (auto it = idle_loops_.find(pc_); it != idle_loops_.end()) {
+            if (uint64_t executed = fast_forward_idle_loop(it->second)) {
+                return executed;
+            }
+        }
+    }
+
     riscv_sim::Block* blk = th_code_.lookup(pc_);
 
     if (blk) {
+        if (th_code_.is_jit_enabled() && trace_threshold_ != 0 && !blk->is_trace &&
+            blk->get_search_rate() == trace_threshold_) {
+            return record_trace();
+        }
         return execute_cached_block(*this, blk);
     }
 
@@ -585,6 +922,9 @@ uint64_t Hart::step() {
 
         if ((next_pc_ != pc_ + 4)) {
             debug_cout("Control flow change detected at PC: 0x" + std::to_string(pc_) + ", next PC: 0x" + std::to_string(next_pc_));
+            if (dinstr.format == InstructionFormat::B && next_pc_ < pc_) {
+                find_idle_loop(next_pc_);
+            }
             pc_ = executed_next;
             th_code_.install_bb_if_valid(std::move(new_block));
             break;
@@ -606,6 +946,158 @@ uint64_t Hart::step() {
     return collected;
 }
 
+// Next-executing-tail trace: interprets from the hot block at pc_ and records
+// the path actually taken, through branches, calls and returns, until it comes
+// back to its head, leaves the function it started in, reaches a system
+// instruction or hits the length limit. The trace replaces the block.
+uint64_t Hart::record_trace() {
+    constexpr size_t max_trace_length = 256;
+
+    riscv_sim::Block trace;
+    trace.start_pc = static_cast<uint32_t>(pc_);
+    trace.is_trace = true;
+    const uint64_t head = pc_;
+    uint64_t executed = 0;
+    int depth = 0;
+
+    while (executed < max_trace_length && instr_counter_ + executed < instr_deadline_) {
+        const uint64_t pc = pc_;
+        DecodedInstruction dinstr = riscv_sim::decoder::decode(static_cast<uint32_t>(fetch(pc)));
+        next_pc_ = pc + 4;
+        riscv_sim::executer::execute(dinstr, *this);
+        ++executed;
+        trace.instrs.push_back(dinstr);
+        trace.instr_pcs.push_back(pc);
+        pc_ = next_pc_;
+
+        const bool is_jump = dinstr.opcode == InstructionOpcode::JAL || dinstr.opcode == InstructionOpcode::JALR;
+        const bool is_ret = dinstr.opcode == InstructionOpcode::JALR && dinstr.rd == 0 &&
+                            dinstr.rs1 == 1 && dinstr.imm == 0;
+        if (is_halt() || dinstr.opcode == InstructionOpcode::ECALL ||
+            dinstr.opcode == InstructionOpcode::CSRW || dinstr.opcode == InstructionOpcode::SFENCE_VMA ||
+            dinstr.opcode == InstructionOpcode::UNKNOWN) {
+            break;
+        }
+        if (is_jump && dinstr.rd != 0) {
+            ++depth;
+        }
+        if (is_ret && depth-- == 0) {
+            break;
+        }
+        if (!is_exec_pc(pc_) || is_native_call(pc_) || find_idle_loop(pc_) != nullptr) {
+            break;
+        }
+        if (pc_ == head && depth == 0) {
+            trace.trace_loops = true;
+            break;
+        }
+    }
+    instr_counter_ += executed;
+
+    th_code_.install_and_jit(std::move(trace));
+    return executed;
+}
+
+const riscv_sim::IdleLoop* Hart::find_idle_loop(uint64_t head) {
+    if (auto it = idle_loops_.find(head); it != idle_loops_.end()) {
+        return &it->second;
+    }
+    if (!idle_loop_checked_.insert(head).second) {
+        return nullptr;
+    }
+    auto decode = [&](uint64_t pc) -> std::optional<DecodedInstruction> {
+        if (!is_exec_pc(pc)) {
+            return std::nullopt;
+        }
+        return riscv_sim::decoder::decode(static_cast<uint32_t>(fetch(pc)));
+    };
+    auto loop = riscv_sim::match_idle_loop(head, decode);
+    if (!loop) {
+        return nullptr;
+    }
+    return &idle_loops_.emplace(head, std::move(*loop)).first->second;
+}
+
+// Whether a load of the loop reads a device page: a device can change the
+// value without this hart writing it. Base registers are loop-invariant, so
+// their current values give the polled addresses.
+bool Hart::polls_device(const riscv_sim::IdleLoop& loop) {
+    if (!mmu_.has_devices()) {
+        return false;
+    }
+    for (const auto& instr : loop.body) {
+        if (!riscv_sim::idle_loop_detail::is_load(instr.opcode)) {
+            continue;
+        }
+        const va_t va = get_reg(instr.rs1) + static_cast<int64_t>(instr.imm);
+        auto tr = mmu_.translate<AccessType::Load>(va, get_context_for_MMU());
+        if (!tr.e.is_none() || mmu_.is_device_range(tr.pa, sizeof(reg_t))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs an idle loop at pc_ to its end, or as far as the instruction budget
+// allows, without interpreting every iteration. Returns the instructions
+// accounted for, 0 to leave the loop to normal execution. Modules see every
+// instruction, so nothing is skipped while any are registered.
+uint64_t Hart::fast_forward_idle_loop(const riscv_sim::IdleLoop& loop) {
+    if (has_module_callbacks()) {
+        return 0;
+    }
+    const uint64_t length = loop.body.size();
+    // Whole iterations left before the deadline; always at least one so the
+    // dispatcher makes progress
+    auto budget_iterations = [&](uint64_t counter) {
+        if (instr_deadline_ == UINT64_MAX) {
+            return (UINT64_MAX - counter) / length;
+        }
+        const uint64_t left = (counter < instr_deadline_) ? instr_deadline_ - counter : 0;
+        return std::max<uint64_t>(left / length, 1);
+    };
+
+    if (loop.kind == riscv_sim::IdleLoop::Kind::Counter) {
+        const DecodedInstruction& br = loop.branch();
+        const uint8_t bound_reg = (br.rs1 == loop.counter) ? br.rs2 : br.rs1;
+        const reg_t value = get_reg(loop.counter);
+        auto trips = riscv_sim::counter_loop_trip_count(loop, value, get_reg(bound_reg));
+        if (!trips) {
+            return 0;
+        }
+        const uint64_t iterations = std::min(*trips, budget_iterations(instr_counter_));
+        if (iterations == 0) {
+            return 0;
+        }
+        set_reg(loop.counter, value + iterations * static_cast<uint64_t>(loop.step));
+        pc_ = (iterations == *trips) ? loop.branch_pc() + 4 : loop.head;
+        instr_counter_ += iterations * length;
+        return iterations * length;
+    }
+
+    // Spin: one real iteration polls memory; if it goes round and the polled
+    // values are RAM, nothing can change them, so the rest of the budget is
+    // spent spinning. Without a budget there is nothing to skip to.
+    uint64_t executed = 0;
+    for (const auto& instr : loop.body) {
+        next_pc_ = pc_ + 4;
+        riscv_sim::executer::execute(instr, *this);
+        ++executed;
+        pc_ = next_pc_;
+        if (is_halt()) {
+            break;
+        }
+    }
+    instr_counter_ += executed;
+    if (pc_ != loop.head || is_halt() || instr_deadline_ == UINT64_MAX || polls_device(loop)) {
+        return executed;
+    }
+    const uint64_t left = (instr_counter_ < instr_deadline_) ? instr_deadline_ - instr_counter_ : 0;
+    const uint64_t skipped = left / length * length;
+    instr_counter_ += skipped;
+    return executed + skipped;
+}
+
 #ifdef ENABLE_MODULES
 void Hart::add_module(std::shared_ptr<Module> mod) {
     modules_.push_back(mod);
@@ -4,10 +4,17 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 #include <memory/mmu.hpp>
 #include "threaded_code.hpp"
+#include "idle_loop.hpp"
 #include "sim_config.hpp"
+#include "jit/jump_table.hpp"
 #include "decode_execute_module/instruction_opcodes_gen.hpp"
 
 #ifdef ENABLE_MODULES
@@ -61,12 +68,21 @@ class Hart {
 
     void set_csr(uint16_t reg_num, reg_t value);
     reg_t get_csr(uint16_t reg_num) const;
+    // SFENCE.VMA rs1, rs2; takes register numbers since x0 widens the fence
+    void sfence_vma(uint8_t rs1, uint8_t rs2);
+    void sfence_vma(std::optional<va_t> va, std::optional<uint16_t> asid);
 
     reg_t get_pc() const;
     reg_t* get_pc_ptr();
     void set_pc(reg_t value);
     void set_next_pc(reg_t value);
     uint64_t* get_instr_counter_ptr();
+    uint64_t* get_instr_deadline_ptr();
+
+    // Limits how many more instructions may retire before compiled code and
+    // run_until_pc hand control back to the caller; 0 means unlimited.
+    void set_instr_budget(uint64_t budget);
+    bool is_budget_exhausted() const;
 
     uint64_t step();
     
@@ -80,15 +96,35 @@ class Hart {
         uint64_t end;
     };
     void set_exec_ranges(std::vector<CodeRange> ranges);
+    // Loaded segments that are never written: jump tables are read from here
+    void set_rodata_ranges(std::vector<CodeRange> ranges);
     bool predecode_and_jit_if_small();
+    void write_jit_exit_report(std::ostream& out) const;
     bool ensure_jit_function(uint64_t entry_pc);
     void execute_jitted_function(uint64_t entry_pc);
     void run_until_pc(uint64_t target_pc);
 
+    // Well-known guest library routines the hart can run natively: a call to
+    // one of their entry points executes the host routine and returns to ra.
+    enum class NativeCall : uint8_t {
+        Memcpy, Memmove, Memset, Strlen, Strcmp,
+        Muldi3, Divdi3, Udivdi3, Moddi3, Umoddi3,
+    };
+    static std::optional<NativeCall> native_call_by_name(std::string_view name);
+    // Ignored unless native_libcalls is set in the config
+    void set_native_calls(std::unordered_map<uint64_t, NativeCall> calls);
+    bool is_native_call(uint64_t pc) const;
+    // Runs the routine at pc with the guest's a0..a2 and returns to ra; false
+    // when it does not apply (the guest code then runs as usual).
+    bool try_native_call(uint64_t pc);
+
     // Memory access
     reg_t load(va_t addr, int size);
     uint32_t fetch(va_t addr);
     void store(va_t addr, reg_t value, int size);
+    // Fixed-size accesses; instantiated for N = 1, 2, 4, 8
+    template<int N> mem_word_t<N> load(va_t addr);
+    template<int N> void store(va_t addr, mem_word_t<N> value);
 
 
     // Traps
@@ -120,11 +156,25 @@ class Hart {
     uint8_t* get_memory_ptr();
     size_t get_memory_size() const;
     bool is_paging_disabled() const;    
+    // Physical range [first, second) covering every MMIO device, empty with none
+    std::pair<pa_t, pa_t> mmio_hull() const;
 private:
 
     uint64_t execute_cached_block(Hart& hart, riscv_sim::Block* blk);
+    uint64_t record_trace();
     bool build_function_block(uint64_t entry_pc, riscv_sim::Block& blk, std::vector<uint64_t>& call_targets);
+    std::vector<uint64_t> layout_function_block(const std::vector<uint64_t>& pcs,
+                                                const std::vector<DecodedInstruction>& instrs,
+                                                uint64_t entry_pc,
+                                                const jit::JumpTargets& jump_tables) const;
+    std::optional<riscv_sim::Block::InlineBody> find_inline_callee(uint64_t entry_pc);
+    std::optional<jit::JumpTable> find_jump_table(uint64_t jalr_pc);
+    bool is_rodata(uint64_t addr, int size) const;
     bool is_exec_pc(uint64_t pc) const;
+    const riscv_sim::IdleLoop* find_idle_loop(uint64_t head);
+    uint64_t fast_forward_idle_loop(const riscv_sim::IdleLoop& loop);
+    bool polls_device(const riscv_sim::IdleLoop& loop);
+    uint8_t* guest_span(uint64_t addr, uint64_t size);
 
     reg_t pc_;
     MMU &mmu_;
@@ -133,12 +183,26 @@ private:
     bool halt_;
     
     reg_t csr_satp_;
+    // Page fetch() last read from; page-aligned, so all-ones never matches
+    static constexpr reg_t no_fetch_page = ~reg_t{0};
+    reg_t fetch_page_va_ = no_fetch_page;
+    const uint8_t* fetch_page_host_ = nullptr;
     PrivilegeMode prv_;
     std::vector<CodeRange> exec_ranges_;
+    std::vector<CodeRange> rodata_ranges_;
 
     uint32_t max_cached_bb_size_;
+    uint32_t max_inline_size_{0};
+    uint64_t trace_threshold_{0};     // dispatches of a block before its trace is recorded
+    bool native_libcalls_{false};
+    std::unordered_map<uint64_t, NativeCall> native_calls_;
+    // Idle loops by head pc, and every pc already checked for one
+    std::unordered_map<uint64_t, riscv_sim::IdleLoop> idle_loops_;
+    std::unordered_set<uint64_t> idle_loop_checked_;
     riscv_sim::ThreadedCode<Hart> th_code_;
     uint64_t instr_counter_{0};
+    // Must stay next to instr_counter_: JIT code addresses it relative to the counter
+    uint64_t instr_deadline_{UINT64_MAX};
 
 #ifdef ENABLE_MODULES
     std::vector<std::shared_ptr<Module>> modules_;
@@ -166,7 +230,11 @@ private:
 
 private:
     template<AccessType type>
-    pa_t va_to_pa (va_t va);
+    pa_t va_to_pa (va_t va, size_t size);
+    bool host_access_allowed() const;
+    bool has_module_callbacks() const;
+    void drop_fetch_page();
     
     pa_t satp_to_root_table(const reg_t satp) const;
+    static uint16_t satp_to_asid(const reg_t satp);
 };
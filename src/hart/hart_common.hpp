@@ -12,6 +12,7 @@ enum class ExceptionCause{
     None,
     UnknowInstruction,
     PageFault,
+    AccessFault,    // physical address neither RAM nor a device
 };
 
 enum class AccessType : uint64_t {
@@ -31,6 +32,7 @@ public:
             case ExceptionCause::None: return "None";
             case ExceptionCause::UnknowInstruction: return "UnknowInstruction";
             case ExceptionCause::PageFault: return "PageFault";
+            case ExceptionCause::AccessFault: return "AccessFault";
             default: return "Unknown";
         }
     }
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "decode_execute_module/common.hpp"
+
+namespace riscv_sim {
+
+// A tight loop that does nothing but count or poll: one straight run of
+// instructions from head to a conditional branch back to head.
+//
+//     Counter:  addi  c, c, step        Spin:  lw    t, off(base)
+//               bne   c, r, head               andi  t, t, mask     optional
+//                                              beqz  t, head
+//
+// Nops may be mixed in. The bound r and the polled address never change
+// inside the loop, so a counter loop's trip count has a closed form and a
+// spin loop that goes round once goes round until something else writes
+// the polled memory.
+struct IdleLoop {
+    enum class Kind { Counter, Spin };
+
+    Kind kind = Kind::Counter;
+    uint64_t head = 0;
+    std::vector<DecodedInstruction> body;   // branch last
+    uint8_t counter = 0;                    // Counter only
+    int64_t step = 0;
+
+    uint64_t branch_pc() const { return head + 4 * (body.size() - 1); }
+    const DecodedInstruction& branch() const { return body.back(); }
+};
+
+namespace idle_loop_detail {
+
+inline bool is_load(InstructionOpcode op) {
+    switch (op) {
+        case InstructionOpcode::LB:
+        case InstructionOpcode::LH:
+        case InstructionOpcode::LW:
+        case InstructionOpcode::LD:
+        case InstructionOpcode::LBU:
+        case InstructionOpcode::LHU:
+        case InstructionOpcode::LWU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// In-place masking or shifting of a polled value
+inline bool is_mask(const DecodedInstruction& instr) {
+    switch (instr.opcode) {
+        case InstructionOpcode::ANDI:
+        case InstructionOpcode::ORI:
+        case InstructionOpcode::XORI:
+        case InstructionOpcode::SLLI:
+        case InstructionOpcode::SRLI:
+        case InstructionOpcode::SRAI:
+            return instr.rd == instr.rs1;
+        default:
+            return false;
+    }
+}
+
+// Whether the branch is taken for operand values lhs and rhs
+inline bool branch_taken(InstructionOpcode op, uint64_t lhs, uint64_t rhs) {
+    switch (op) {
+        case InstructionOpcode::BEQ:  return lhs == rhs;
+        case InstructionOpcode::BNE:  return lhs != rhs;
+        case InstructionOpcode::BLT:  return static_cast<int64_t>(lhs) < static_cast<int64_t>(rhs);
+        case InstructionOpcode::BGE:  return static_cast<int64_t>(lhs) >= static_cast<int64_t>(rhs);
+        case InstructionOpcode::BLTU: return lhs < rhs;
+        case InstructionOpcode::BGEU: return lhs >= rhs;
+        default:                      return false;
+    }
+}
+
+}
+
+// Matches the loop starting at head; decode(pc) returns the instruction at
+// pc if it is code.
+template<typename Decode>
+std::optional<IdleLoop> match_idle_loop(uint64_t head, Decode&& decode) {
+    using namespace idle_loop_detail;
+    constexpr size_t max_body = 8;
+
+    IdleLoop loop;
+    loop.head = head;
+    uint32_t written = 0;
+    uint32_t loaded = 0;
+    uint32_t load_bases = 0;
+    bool has_counter = false;
+
+    for (uint64_t pc = head; loop.body.size() < max_body; pc += 4) {
+        std::optional<DecodedInstruction> instr = decode(pc);
+        if (!instr) {
+            return std::nullopt;
+        }
+        loop.body.push_back(*instr);
+
+        if (instr->format == InstructionFormat::B) {
+            if (pc + static_cast<int64_t>(instr->imm) != head) {
+                return std::nullopt;
+            }
+            break;
+        }
+        if (instr->opcode == InstructionOpcode::ADDI && instr->rd == 0) {
+            continue;
+        }
+        if (instr->rd == 0) {
+            return std::nullopt;
+        }
+        if (instr->opcode == InstructionOpcode::ADDI && instr->rd == instr->rs1 && instr->imm != 0 &&
+            !has_counter && !(written & (1u << instr->rd))) {
+            has_counter = true;
+            loop.counter = instr->rd;
+            loop.step = instr->imm;
+        } else if (is_load(instr->opcode)) {
+            loaded |= 1u << instr->rd;
+            load_bases |= 1u << instr->rs1;
+        } else if (!is_mask(*instr) || !(loaded & (1u << instr->rd))) {
+            return std::nullopt;
+        }
+        written |= 1u << instr->rd;
+    }
+
+    if (loop.body.empty() || loop.branch().format != InstructionFormat::B ||
+        loop.branch_pc() + static_cast<int64_t>(loop.branch().imm) != head) {
+        return std::nullopt;
+    }
+    const DecodedInstruction& br = loop.branch();
+    const uint32_t operands = (1u << br.rs1) | (1u << br.rs2);
+    if (has_counter == (loaded != 0) || (load_bases & written) != 0 || (operands & written) == 0) {
+        return std::nullopt;
+    }
+    if (has_counter) {
+        // The counter against a loop-invariant bound
+        if (br.opcode == InstructionOpcode::BEQ || br.rs1 == br.rs2) {
+            return std::nullopt;
+        }
+        loop.kind = IdleLoop::Kind::Counter;
+    } else {
+        loop.kind = IdleLoop::Kind::Spin;
+    }
+    return loop;
+}
+
+// Iterations a counter loop runs before its branch falls through, starting
+// with the counter at value and the bound at bound; nullopt when the counter
+// would wrap around first.
+inline std::optional<uint64_t> counter_loop_trip_count(const IdleLoop& loop, uint64_t value, uint64_t bound) {
+    using idle_loop_detail::branch_taken;
+    const DecodedInstruction& br = loop.branch();
+    const bool counter_lhs = (br.rs1 == loop.counter);
+    const int64_t step = loop.step;
+    auto taken_after = [&](uint64_t iterations) {
+        const uint64_t v = value + iterations * static_cast<uint64_t>(step);
+        return counter_lhs ? branch_taken(br.opcode, v, bound) : branch_taken(br.opcode, bound, v);
+    };
+
+    if (br.opcode == InstructionOpcode::BNE) {
+        // Runs until the counter lands exactly on the bound; in 128 bits, as
+        // INT64_MIN / -1 does not fit
+        const __int128 distance = static_cast<int64_t>(bound - value);
+        if (distance == 0 || (distance < 0) != (step < 0) || distance % step != 0) {
+            return std::nullopt;
+        }
+        return static_cast<uint64_t>(distance / step);
+    }
+
+    // Ordered compares are monotonic in the iteration count for as long as
+    // the counter stays inside the compared range
+    const bool is_signed = (br.opcode == InstructionOpcode::BLT || br.opcode == InstructionOpcode::BGE);
+    const __int128 start = is_signed ? static_cast<__int128>(static_cast<int64_t>(value)) : static_cast<__int128>(value);
+    const __int128 lo = is_signed ? static_cast<__int128>(INT64_MIN) : 0;
+    const __int128 hi = is_signed ? static_cast<__int128>(INT64_MAX) : static_cast<__int128>(UINT64_MAX);
+    const __int128 room = (step > 0) ? (hi - start) / step : (start - lo) / -static_cast<__int128>(step);
+    if (room == 0) {
+        return std::nullopt;
+    }
+    if (!taken_after(1)) {
+        return 1;
+    }
+    uint64_t last = static_cast<uint64_t>(std::min<__int128>(room, UINT64_MAX));
+    if (taken_after(last)) {
+        return std::nullopt;
+    }
+    // taken_after(first) holds, taken_after(last) does not
+    uint64_t first = 1;
+    while (last - first > 1) {
+        const uint64_t mid = first + (last - first) / 2;
+        if (taken_after(mid)) {
+            first = mid;
+        } else {
+            last = mid;
+        }
+    }
+    return last;
+}
+
+}
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <unordered_map>
 #include <cstddef>
 #include <memory>
 
@@ -23,11 +24,24 @@ public:
     std::vector<DecodedInstruction> instrs;
     std::vector<uint64_t> instr_pcs;
     bool is_function_block = false;
+    // A recorded hot path; trace_loops when it ends back at start_pc
+    bool is_trace = false;
+    bool trace_loops = false;
+    // Function blocks: indirect jump pc -> targets of its recognised jump table
+    std::unordered_map<uint64_t, std::vector<uint64_t>> jump_tables;
+
+    // Function blocks: leaf callees compiled into their call sites, by entry pc
+    struct InlineBody {
+        std::vector<uint64_t> pcs;              // entry first
+        std::vector<DecodedInstruction> instrs;
+    };
+    std::unordered_map<uint64_t, InlineBody> inline_callees;
 
     using ExecFn = void (*)(const DecodedInstruction &instr, Hart& hart);
     std::vector<ExecFn> exec_fns;
 
     bool get_is_jitted() const { return is_jitted;}
+    uint64_t get_search_rate() const { return search_rate; }
     std::unique_ptr<jit::JITBasic_block> jitted_bb;
 private:
     void set_jitted_bb(std::unique_ptr<jit::JITBasic_block> jitted_bb_)  { 
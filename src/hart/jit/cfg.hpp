@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "decode_execute_module/common.hpp"
+#include "jump_table.hpp"
+
+namespace jit {
+
+// Control-flow view of a function block: basic blocks over the decoded
+// instructions, dominators and natural loops.
+class FunctionCfg {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct Node {
+        uint64_t start_pc = 0;
+        std::vector<uint64_t> pcs;          // in address order
+        std::vector<size_t> succs;
+        std::vector<size_t> preds;
+    };
+
+    struct Loop {
+        size_t header = npos;
+        std::vector<size_t> nodes;          // includes the header
+        bool innermost = true;
+    };
+
+    static bool is_control_transfer(const DecodedInstruction& instr) {
+        return instr.format == InstructionFormat::B ||
+               instr.opcode == InstructionOpcode::JAL ||
+               instr.opcode == InstructionOpcode::JALR ||
+               instr.opcode == InstructionOpcode::ECALL;
+    }
+
+    // Whether execution can continue at pc + 4 once instr is done. Calls count:
+    // control comes back to the return address.
+    static bool can_fall_through(const DecodedInstruction& instr) {
+        switch (instr.opcode) {
+            case InstructionOpcode::JAL:
+            case InstructionOpcode::JALR:
+                return instr.rd != 0;
+            case InstructionOpcode::ECALL:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    FunctionCfg(const std::vector<uint64_t>& pcs,
+                const std::vector<DecodedInstruction>& instrs,
+                uint64_t entry_pc,
+                const JumpTargets* jump_tables = nullptr) {
+        if (jump_tables != nullptr) {
+            jump_tables_ = *jump_tables;
+        }
+        for (size_t i = 0; i < pcs.size(); ++i) {
+            instrs_.emplace(pcs[i], instrs[i]);
+        }
+        if (instrs_.count(entry_pc) == 0) {
+            return;
+        }
+        build_nodes(entry_pc);
+        compute_dominators();
+        find_loops();
+    }
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    const std::vector<Loop>& loops() const { return loops_; }
+    const DecodedInstruction& instr_at(uint64_t pc) const { return instrs_.at(pc); }
+
+    // Number of natural loops containing node n
+    uint32_t loop_depth(size_t n) const { return loop_depth_[n]; }
+
+    size_t node_of(uint64_t pc) const {
+        auto it = node_by_pc_.find(pc);
+        return it == node_by_pc_.end() ? npos : it->second;
+    }
+
+    // Bottom-up chain layout (Pettis and Hansen): edges are visited from the
+    // heaviest down and join the chain ending at their source to the chain
+    // starting at their target, so hot edges become fall-throughs. Chains are
+    // then placed from the entry, each next one being the most strongly
+    // reached from code already placed; cold chains go last.
+    template<typename EdgeWeight>
+    std::vector<size_t> layout(EdgeWeight&& weight, const std::vector<bool>& cold) const {
+        struct Edge {
+            size_t from;
+            size_t to;
+            double weight;
+        };
+        std::vector<Edge> edges;
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+            for (auto s : nodes_[n].succs) {
+                // The entry has to stay first in the layout
+                if (s != n && s != 0 && cold[n] == cold[s]) {
+                    edges.push_back(Edge{n, s, static_cast<double>(weight(n, s))});
+                }
+            }
+        }
+        std::stable_sort(edges.begin(), edges.end(),
+                         [](const Edge& a, const Edge& b) { return a.weight > b.weight; });
+
+        std::vector<std::vector<size_t>> chains(nodes_.size());
+        std::vector<size_t> chain_of(nodes_.size());
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+            chains[n] = {n};
+            chain_of[n] = n;
+        }
+        for (const auto& e : edges) {
+            const size_t from_chain = chain_of[e.from];
+            const size_t to_chain = chain_of[e.to];
+            if (from_chain == to_chain || chains[from_chain].back() != e.from ||
+                chains[to_chain].front() != e.to) {
+                continue;
+            }
+            for (auto n : chains[to_chain]) {
+                chain_of[n] = from_chain;
+            }
+            chains[from_chain].insert(chains[from_chain].end(),
+                                      chains[to_chain].begin(), chains[to_chain].end());
+            chains[to_chain].clear();
+        }
+
+        std::vector<size_t> order;
+        std::vector<bool> placed(nodes_.size(), false);
+        auto place = [&](size_t chain) {
+            for (auto n : chains[chain]) {
+                placed[n] = true;
+                order.push_back(n);
+            }
+            chains[chain].clear();
+        };
+        if (!nodes_.empty()) {
+            place(chain_of[0]);
+        }
+        for (bool allow_cold : {false, true}) {
+            while (true) {
+                size_t best_chain = npos;
+                double best = -1.0;
+                for (size_t c = 0; c < chains.size(); ++c) {
+                    if (chains[c].empty() || (!allow_cold && cold[chains[c].front()])) {
+                        continue;
+                    }
+                    double w = 0.0;
+                    for (auto n : chains[c]) {
+                        for (auto p : nodes_[n].preds) {
+                            if (placed[p]) {
+                                w = std::max(w, static_cast<double>(weight(p, n)));
+                            }
+                        }
+                    }
+                    if (w > best) {
+                        best = w;
+                        best_chain = c;
+                    }
+                }
+                if (best_chain == npos) {
+                    break;
+                }
+                place(best_chain);
+            }
+        }
+        return order;
+    }
+
+    bool dominates(size_t a, size_t b) const {
+        if (b >= idom_.size() || idom_[b] == npos) {
+            return false;
+        }
+        while (true) {
+            if (a == b) {
+                return true;
+            }
+            if (b == 0) {
+                return false;
+            }
+            b = idom_[b];
+        }
+    }
+
+private:
+    void build_nodes(uint64_t entry_pc) {
+        std::unordered_set<uint64_t> leaders;
+        leaders.insert(entry_pc);
+        for (const auto& [pc, instr] : instrs_) {
+            if (instrs_.count(pc - 4) == 0) {
+                leaders.insert(pc);
+            }
+            if (is_control_transfer(instr)) {
+                leaders.insert(pc + 4);
+            }
+            if (instr.format == InstructionFormat::B || instr.opcode == InstructionOpcode::JAL) {
+                leaders.insert(pc + static_cast<int64_t>(instr.imm));
+            }
+        }
+        for (const auto& [pc, targets] : jump_tables_) {
+            leaders.insert(targets.begin(), targets.end());
+        }
+
+        // Entry first, the rest in address order
+        std::vector<uint64_t> starts;
+        for (auto pc : leaders) {
+            if (instrs_.count(pc) != 0 && pc != entry_pc) {
+                starts.push_back(pc);
+            }
+        }
+        std::sort(starts.begin(), starts.end());
+        starts.insert(starts.begin(), entry_pc);
+
+        nodes_.resize(starts.size());
+        for (size_t n = 0; n < starts.size(); ++n) {
+            Node& node = nodes_[n];
+            node.start_pc = starts[n];
+            uint64_t pc = starts[n];
+            while (true) {
+                node.pcs.push_back(pc);
+                node_by_pc_.emplace(pc, n);
+                const uint64_t next = pc + 4;
+                if (is_control_transfer(instrs_.at(pc)) || instrs_.count(next) == 0 ||
+                    leaders.count(next) != 0) {
+                    break;
+                }
+                pc = next;
+            }
+        }
+
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+            const uint64_t last_pc = nodes_[n].pcs.back();
+            const DecodedInstruction& last = instrs_.at(last_pc);
+            if (last.format == InstructionFormat::B ||
+                (last.opcode == InstructionOpcode::JAL && last.rd == 0)) {
+                add_edge(n, last_pc + static_cast<int64_t>(last.imm));
+            }
+            if (can_fall_through(last)) {
+                add_edge(n, last_pc + 4);
+            }
+            if (auto it = jump_tables_.find(last_pc); it != jump_tables_.end()) {
+                for (auto target : it->second) {
+                    add_edge(n, target);
+                }
+            }
+        }
+    }
+
+    void add_edge(size_t from, uint64_t to_pc) {
+        auto it = node_by_pc_.find(to_pc);
+        if (it == node_by_pc_.end()) {
+            return;
+        }
+        auto& succs = nodes_[from].succs;
+        if (std::find(succs.begin(), succs.end(), it->second) != succs.end()) {
+            return;
+        }
+        succs.push_back(it->second);
+        nodes_[it->second].preds.push_back(from);
+    }
+
+    // Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder.
+    void compute_dominators() {
+        std::vector<size_t> rpo;
+        std::vector<size_t> order(nodes_.size(), npos);
+        std::vector<bool> visited(nodes_.size(), false);
+        std::vector<std::pair<size_t, size_t>> stack{{0, 0}};
+        visited[0] = true;
+        while (!stack.empty()) {
+            auto& [n, next_succ] = stack.back();
+            if (next_succ < nodes_[n].succs.size()) {
+                const size_t s = nodes_[n].succs[next_succ++];
+                if (!visited[s]) {
+                    visited[s] = true;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+            rpo.push_back(n);
+            stack.pop_back();
+        }
+        std::reverse(rpo.begin(), rpo.end());
+        for (size_t i = 0; i < rpo.size(); ++i) {
+            order[rpo[i]] = i;
+        }
+
+        idom_.assign(nodes_.size(), npos);
+        idom_[0] = 0;
+        auto intersect = [&](size_t a, size_t b) {
+            while (a != b) {
+                while (order[a] > order[b]) a = idom_[a];
+                while (order[b] > order[a]) b = idom_[b];
+            }
+            return a;
+        };
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = 1; i < rpo.size(); ++i) {
+                const size_t n = rpo[i];
+                size_t new_idom = npos;
+                for (auto p : nodes_[n].preds) {
+                    if (idom_[p] == npos) {
+                        continue;
+                    }
+                    new_idom = (new_idom == npos) ? p : intersect(p, new_idom);
+                }
+                if (new_idom != idom_[n]) {
+                    idom_[n] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // A back-edge latch -> header (header dominates latch) defines the loop as
+    // every node reaching the latch without passing through the header.
+    void find_loops() {
+        std::unordered_map<size_t, size_t> loop_by_header;
+        for (size_t latch = 0; latch < nodes_.size(); ++latch) {
+            for (auto header : nodes_[latch].succs) {
+                if (!dominates(header, latch)) {
+                    continue;
+                }
+                auto [it, inserted] = loop_by_header.emplace(header, loops_.size());
+                if (inserted) {
+                    loops_.push_back(Loop{header, {header}, true});
+                }
+                Loop& loop = loops_[it->second];
+                std::vector<size_t> worklist{latch};
+                while (!worklist.empty()) {
+                    const size_t n = worklist.back();
+                    worklist.pop_back();
+                    if (std::find(loop.nodes.begin(), loop.nodes.end(), n) != loop.nodes.end()) {
+                        continue;
+                    }
+                    loop.nodes.push_back(n);
+                    for (auto p : nodes_[n].preds) {
+                        if (idom_[p] != npos) {
+                            worklist.push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+
+        loop_depth_.assign(nodes_.size(), 0);
+        for (auto& loop : loops_) {
+            for (auto n : loop.nodes) {
+                ++loop_depth_[n];
+            }
+            for (const auto& other : loops_) {
+                if (other.header != loop.header &&
+                    std::find(loop.nodes.begin(), loop.nodes.end(), other.header) != loop.nodes.end()) {
+                    loop.innermost = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::unordered_map<uint64_t, DecodedInstruction> instrs_;
+    JumpTargets jump_tables_;
+    std::unordered_map<uint64_t, size_t> node_by_pc_;
+    std::vector<Node> nodes_;
+    std::vector<size_t> idom_;
+    std::vector<Loop> loops_;
+    std::vector<uint32_t> loop_depth_;
+};
+
+}
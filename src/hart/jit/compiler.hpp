@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <iostream>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include <asmjit/x86.h>
@@ -12,20 +15,37 @@
 #include "jit_instruction_factory.hpp"
 #include "jit_basic_block.hpp"
 #include "basic_block.hpp"
+#include "cfg.hpp"
 class Hart;
 
 namespace jit {
 
 class JITImpl {
 public:
-    std::unique_ptr<JITBasic_block> compile_bb(std::vector<DecodedInstruction> instrs, Hart* hart) const {
+    std::unique_ptr<JITBasic_block> compile_bb(std::vector<DecodedInstruction> instrs, uint64_t start_pc, Hart* hart) const {
         std::unique_ptr<JITBasic_block> bb = std::make_unique<JITBasic_block>();
 #if defined(__x86_64__)
-        jit::JITFunctionFactory<Hart> factory{hart, bb->asmx86.get(), &bb->exit_label};
-        for(auto&  instr : instrs) {
-            // std::cout << int(instr.format) << ":" << int(instr.opcode) << std::endl;
-            factory.compile(bb->asmx86.get(), hart, instr);
+        jit::JITFunctionFactory<Hart> factory{hart, bb->asmx86.get(), &bb->exit_label, false, bb->exit_table.get()};
+        // Straight-line liveness: everything is live where the block ends or
+        // control can leave it
+        std::vector<uint8_t> dead_rd(instrs.size(), 0);
+        uint32_t live = all_regs;
+        for (size_t i = instrs.size(); i-- > 0;) {
+            const auto& instr = instrs[i];
+            if (writes_rd(instr) && !FunctionCfg::is_control_transfer(instr) && !(live & reg_bit(instr.rd))) {
+                dead_rd[i] = instr.rd;
+            }
+            const bool leaves = FunctionCfg::is_control_transfer(instr) ||
+                                leaves_compiled_code(instr, factory.memory_can_fault());
+            live = leaves ? all_regs : live_in(instr, live);
+        }
+        for (size_t i = 0; i < instrs.size(); ++i) {
+            // std::cout << int(instrs[i].format) << ":" << int(instrs[i].opcode) << std::endl;
+            factory.set_dead_rd(dead_rd[i]);
+            factory.set_site_pc(start_pc + 4 * i);
+            factory.compile(bb->asmx86.get(), hart, instrs[i]);
         }
+        factory.emit_block_end_x86(bb->asmx86.get());
 #else
         jit::JITFunctionFactory<Hart> factory{hart, bb->asma64.get()};
         for(auto&  instr : instrs) {
@@ -39,16 +59,345 @@ public:
     }
 
     std::unique_ptr<JITBasic_block> compile_block(const riscv_sim::Block& blk, Hart* hart) const {
+        if (blk.is_trace && blk.instr_pcs.size() == blk.instrs.size()) {
+            return compile_trace(blk, hart);
+        }
         if (blk.is_function_block && blk.instr_pcs.size() == blk.instrs.size()) {
             return compile_function_block(blk, hart);
         }
-        return compile_bb(blk.instrs, hart);
+        return compile_bb(blk.instrs, blk.start_pc, hart);
     }
 private:
+    // PCs that can be entered other than by falling through from pc - 4.
+    static std::unordered_set<uint64_t> collect_jump_targets(const riscv_sim::Block& blk) {
+        std::unordered_set<uint64_t> targets;
+        targets.insert(blk.start_pc);
+        for (size_t i = 0; i < blk.instrs.size(); ++i) {
+            const auto& instr = blk.instrs[i];
+            const uint64_t pc = blk.instr_pcs[i];
+            if (instr.format == InstructionFormat::B || instr.opcode == InstructionOpcode::JAL) {
+                targets.insert(pc + static_cast<int64_t>(instr.imm));
+            }
+            if ((instr.opcode == InstructionOpcode::JAL || instr.opcode == InstructionOpcode::JALR) &&
+                instr.rd != 0) {
+                targets.insert(pc + 4);
+            }
+        }
+        for (const auto& [pc, table] : blk.jump_tables) {
+            targets.insert(table.begin(), table.end());
+        }
+        return targets;
+    }
+
+    using LoopPlan = jit::JITFunctionFactory<Hart>::LoopPlan;
+
+    static void count_reg_uses(const DecodedInstruction& instr, std::array<uint32_t, 32>& uses) {
+        switch (instr.format) {
+            case InstructionFormat::R:
+            case InstructionFormat::S:
+            case InstructionFormat::B:
+                ++uses[instr.rs1];
+                ++uses[instr.rs2];
+                break;
+            case InstructionFormat::I:
+                ++uses[instr.rs1];
+                break;
+            default:
+                break;
+        }
+        if (writes_rd(instr)) {
+            ++uses[instr.rd];
+        }
+    }
+
+    static bool writes_rd(const DecodedInstruction& instr) {
+        return instr.format == InstructionFormat::R || instr.format == InstructionFormat::I ||
+               instr.format == InstructionFormat::U || instr.format == InstructionFormat::J;
+    }
+
+    static constexpr uint32_t all_regs = ~uint32_t{1};    // x0 is never live
+
+    static uint32_t reg_bit(uint8_t reg) {
+        return reg == 0 ? 0 : uint32_t{1} << reg;
+    }
+
+    static uint32_t live_in(const DecodedInstruction& instr, uint32_t live_out) {
+        uint32_t uses = 0;
+        switch (instr.format) {
+            case InstructionFormat::R:
+            case InstructionFormat::S:
+            case InstructionFormat::B:
+                uses = reg_bit(instr.rs1) | reg_bit(instr.rs2);
+                break;
+            case InstructionFormat::I:
+                uses = reg_bit(instr.rs1);
+                break;
+            default:
+                break;
+        }
+        const uint32_t defs = writes_rd(instr) ? reg_bit(instr.rd) : 0;
+        return uses | (live_out & ~defs);
+    }
+
+    // Whether the hart can observe guest state at the instruction: calls,
+    // indirect jumps, system instructions, back-edges, which check the
+    // instruction budget, and memory accesses when they can fault.
+    static bool leaves_compiled_code(const DecodedInstruction& instr, bool memory_can_fault) {
+        if (memory_can_fault && is_memory_access(instr)) {
+            return true;
+        }
+        switch (instr.opcode) {
+            case InstructionOpcode::JAL:
+                return instr.rd != 0 || instr.imm <= 0;
+            case InstructionOpcode::JALR:
+            case InstructionOpcode::ECALL:
+            case InstructionOpcode::CSRW:
+            case InstructionOpcode::SFENCE_VMA:
+            case InstructionOpcode::UNKNOWN:
+                return true;
+            default:
+                return instr.format == InstructionFormat::B && instr.imm <= 0;
+        }
+    }
+
+    static bool is_memory_access(const DecodedInstruction& instr) {
+        switch (instr.opcode) {
+            case InstructionOpcode::LB:
+            case InstructionOpcode::LH:
+            case InstructionOpcode::LW:
+            case InstructionOpcode::LD:
+            case InstructionOpcode::LBU:
+            case InstructionOpcode::LHU:
+            case InstructionOpcode::LWU:
+                return true;
+            default:
+                return instr.format == InstructionFormat::S;
+        }
+    }
+
+    // Guest registers live after each instruction of a function block. Every
+    // point where control can leave compiled code keeps all of them live, so
+    // only writes overwritten on all paths before any read or exit are dead.
+    static std::unordered_map<uint64_t, uint32_t> compute_live_out(const FunctionCfg& cfg, bool memory_can_fault) {
+        const auto& nodes = cfg.nodes();
+        auto node_live_out = [&](size_t n, const std::vector<uint32_t>& live_in_of) {
+            const uint64_t last_pc = nodes[n].pcs.back();
+            const DecodedInstruction& last = cfg.instr_at(last_pc);
+            std::vector<uint64_t> succ_pcs;
+            if (last.format == InstructionFormat::B || last.opcode == InstructionOpcode::JAL) {
+                succ_pcs.push_back(last_pc + static_cast<int64_t>(last.imm));
+            }
+            if (FunctionCfg::can_fall_through(last)) {
+                succ_pcs.push_back(last_pc + 4);
+            }
+            uint32_t out = 0;
+            for (auto pc : succ_pcs) {
+                const size_t s = cfg.node_of(pc);
+                out |= (s == FunctionCfg::npos) ? all_regs : live_in_of[s];
+            }
+            return out;
+        };
+        auto step = [&](uint64_t pc, uint32_t out) {
+            const DecodedInstruction& instr = cfg.instr_at(pc);
+            return leaves_compiled_code(instr, memory_can_fault) ? all_regs : live_in(instr, out);
+        };
+
+        std::vector<uint32_t> live_in_of(nodes.size(), 0);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t n = nodes.size(); n-- > 0;) {
+                uint32_t live = node_live_out(n, live_in_of);
+                for (auto it = nodes[n].pcs.rbegin(); it != nodes[n].pcs.rend(); ++it) {
+                    live = step(*it, live);
+                }
+                if (live != live_in_of[n]) {
+                    live_in_of[n] = live;
+                    changed = true;
+                }
+            }
+        }
+
+        std::unordered_map<uint64_t, uint32_t> live_out;
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            uint32_t live = node_live_out(n, live_in_of);
+            for (auto it = nodes[n].pcs.rbegin(); it != nodes[n].pcs.rend(); ++it) {
+                live_out[*it] = live;
+                live = step(*it, live);
+            }
+        }
+        return live_out;
+    }
+
+    // Pins the most used guest registers of each innermost loop that never
+    // leaves compiled code through a call, ecall, csr write or indirect jump.
+    static std::vector<LoopPlan> plan_loops(const FunctionCfg& cfg) {
+        std::vector<LoopPlan> plans;
+        for (const auto& loop : cfg.loops()) {
+            if (!loop.innermost) {
+                continue;
+            }
+            LoopPlan plan;
+            plan.header_pc = cfg.nodes()[loop.header].start_pc;
+            std::array<uint32_t, 32> uses{};
+            uint32_t written = 0;
+            bool eligible = true;
+            for (auto n : loop.nodes) {
+                for (auto pc : cfg.nodes()[n].pcs) {
+                    const DecodedInstruction& instr = cfg.instr_at(pc);
+                    switch (instr.opcode) {
+                        case InstructionOpcode::JALR:
+                        case InstructionOpcode::ECALL:
+                        case InstructionOpcode::CSRW:
+                        case InstructionOpcode::SFENCE_VMA:
+                        case InstructionOpcode::UNKNOWN:
+                            eligible = false;
+                            break;
+                        case InstructionOpcode::JAL:
+                            eligible = eligible && instr.rd == 0;
+                            break;
+                        default:
+                            break;
+                    }
+                    count_reg_uses(instr, uses);
+                    if (writes_rd(instr) && instr.rd != 0) {
+                        written |= 1u << instr.rd;
+                    }
+                    plan.pcs.insert(pc);
+                }
+            }
+            if (!eligible) {
+                continue;
+            }
+
+            uses[0] = 0;
+            while (plan.pinned.size() < JITFunctionFactory<Hart>::max_pinned_regs) {
+                auto best = std::max_element(uses.begin(), uses.end());
+                if (*best < 2) {
+                    break;
+                }
+                const uint8_t reg = static_cast<uint8_t>(best - uses.begin());
+                plan.pinned.push_back(reg);
+                plan.dirty_mask |= written & (1u << reg);
+                *best = 0;
+            }
+            if (!plan.pinned.empty()) {
+                plans.push_back(std::move(plan));
+            }
+        }
+        return plans;
+    }
+
+#if defined(__x86_64__)
+    // Emits a leaf callee in place of the call described by call_ctx. Its
+    // instructions keep their own pcs, so exits from inside it resume the
+    // interpreter in the callee with ra already set.
+    static void compile_inline_call_x86(JITFunctionFactory<Hart>& factory,
+                                        asmjit::x86::Assembler* asmx86,
+                                        Hart* hart,
+                                        const DecodedInstruction& call,
+                                        const riscv_sim::Block::InlineBody& body,
+                                        const JITFunctionFactory<Hart>::X86ControlFlowContext& call_ctx,
+                                        const asmjit::Label& return_label) {
+        factory.begin_inline_call_x86(asmx86, call, call_ctx);
+
+        std::unordered_map<uint64_t, asmjit::Label> labels;
+        std::unordered_set<uint64_t> jump_targets;
+        for (size_t i = 0; i < body.pcs.size(); ++i) {
+            labels.emplace(body.pcs[i], asmx86->new_label());
+            const auto& instr = body.instrs[i];
+            if (instr.format == InstructionFormat::B || instr.opcode == InstructionOpcode::JAL) {
+                jump_targets.insert(body.pcs[i] + static_cast<int64_t>(instr.imm));
+            }
+        }
+
+        for (size_t i = 0; i < body.pcs.size(); ++i) {
+            const uint64_t pc = body.pcs[i];
+            if (jump_targets.count(pc) != 0) {
+                factory.begin_region_x86(asmx86);
+            }
+            asmx86->bind(labels.at(pc));
+            const JITFunctionFactory<Hart>::X86ControlFlowContext ctx{
+                pc,
+                pc + 4,
+                i + 1 < body.pcs.size() && body.pcs[i + 1] == pc + 4,
+                &labels,
+                nullptr,
+                &return_label
+            };
+            factory.compile_function_x86(asmx86, hart, body.instrs[i], ctx);
+        }
+    }
+#endif
+
+    // A recorded path compiled as one straight line: every branch and indirect
+    // jump is guarded against the direction seen while recording, calls and
+    // jumps continue at their target, and a trace that came back to its head
+    // loops without leaving compiled code.
+    std::unique_ptr<JITBasic_block> compile_trace(const riscv_sim::Block& blk, Hart* hart) const {
+        std::unique_ptr<JITBasic_block> bb = std::make_unique<JITBasic_block>();
+#if defined(__x86_64__)
+        jit::JITFunctionFactory<Hart> factory{hart, bb->asmx86.get(), &bb->exit_label, true, bb->exit_table.get()};
+        asmjit::x86::Assembler* asmx86 = bb->asmx86.get();
+
+        const size_t count = blk.instrs.size();
+        std::vector<asmjit::Label> labels;
+        labels.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            labels.push_back(asmx86->new_label());
+        }
+        const asmjit::Label loop_back = asmx86->new_label();
+
+        factory.set_dead_rd(0);
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t pc = blk.instr_pcs[i];
+            const DecodedInstruction& instr = blk.instrs[i];
+            const bool last = (i + 1 == count);
+            if (i == 0) {
+                factory.begin_region_x86(asmx86);
+            }
+            asmx86->bind(labels[i]);
+
+            // The only in-trace successor is the next recorded instruction
+            std::unordered_map<uint64_t, asmjit::Label> next;
+            if (!last) {
+                next.emplace(blk.instr_pcs[i + 1], labels[i + 1]);
+            } else if (blk.trace_loops) {
+                next.emplace(blk.start_pc, loop_back);
+            }
+            const JITFunctionFactory<Hart>::X86ControlFlowContext ctx{
+                pc,
+                pc + 4,
+                !last && blk.instr_pcs[i + 1] == pc + 4,
+                &next
+            };
+
+            if (!last && instr.format == InstructionFormat::B) {
+                factory.compile_guarded_branch_x86(asmx86, instr, ctx, blk.instr_pcs[i + 1] != pc + 4);
+            } else if (!last && instr.opcode == InstructionOpcode::JAL) {
+                factory.begin_inline_call_x86(asmx86, instr, ctx);
+            } else if (!last && instr.opcode == InstructionOpcode::JALR) {
+                factory.compile_guarded_jalr_x86(asmx86, hart, instr, ctx, blk.instr_pcs[i + 1]);
+            } else {
+                factory.compile_function_x86(asmx86, hart, instr, ctx);
+            }
+        }
+        if (blk.trace_loops) {
+            asmx86->bind(loop_back);
+            factory.emit_trace_loop_back_x86(asmx86, blk.start_pc, labels.front());
+        }
+        factory.emit_deferred_exits_x86(asmx86);
+#else
+        return compile_bb(blk.instrs, blk.start_pc, hart);
+#endif
+        bb->add_code();
+        return bb;
+    }
+
     std::unique_ptr<JITBasic_block> compile_function_block(const riscv_sim::Block& blk, Hart* hart) const {
         std::unique_ptr<JITBasic_block> bb = std::make_unique<JITBasic_block>();
 #if defined(__x86_64__)
-        jit::JITFunctionFactory<Hart> factory{hart, bb->asmx86.get(), &bb->exit_label, true};
+        jit::JITFunctionFactory<Hart> factory{hart, bb->asmx86.get(), &bb->exit_label, true, bb->exit_table.get()};
 
         std::unordered_map<uint64_t, asmjit::Label> labels;
         labels.reserve(blk.instr_pcs.size());
@@ -56,22 +405,107 @@ private:
             labels.emplace(pc, bb->asmx86->new_label());
         }
 
+        const std::unordered_set<uint64_t> jump_targets = collect_jump_targets(blk);
+
+        const FunctionCfg cfg(blk.instr_pcs, blk.instrs, blk.start_pc, &blk.jump_tables);
+        const std::vector<LoopPlan> loop_plans = plan_loops(cfg);
+        const std::unordered_map<uint64_t, uint32_t> live_out = compute_live_out(cfg, factory.memory_can_fault());
+        // rd of the instruction at pc if its write is dead once after_pc is done
+        auto dead_rd = [&](const DecodedInstruction& instr, uint64_t after_pc) -> uint8_t {
+            if (!writes_rd(instr) || FunctionCfg::is_control_transfer(instr)) {
+                return 0;
+            }
+            auto it = live_out.find(after_pc);
+            return (it != live_out.end() && !(it->second & reg_bit(instr.rd))) ? instr.rd : 0;
+        };
+        std::unordered_map<uint64_t, const LoopPlan*> loop_of;
+        for (const auto& plan : loop_plans) {
+            for (auto pc : plan.pcs) {
+                loop_of.emplace(pc, &plan);
+            }
+        }
+        auto find_loop = [&](uint64_t pc) -> const LoopPlan* {
+            auto it = loop_of.find(pc);
+            return it == loop_of.end() ? nullptr : it->second;
+        };
+
         const size_t count = blk.instrs.size();
-        for (size_t i = 0; i < count; ++i) {
+        auto make_ctx = [&](size_t i) {
             const uint64_t pc = blk.instr_pcs[i];
-            bb->asmx86->bind(labels.at(pc));
             const uint64_t next_pc = pc + 4;
             const bool fallthrough_is_next = (i + 1 < count && blk.instr_pcs[i + 1] == next_pc);
-            const jit::JITFunctionFactory<Hart>::X86ControlFlowContext ctx{
+            auto table = blk.jump_tables.find(pc);
+            return jit::JITFunctionFactory<Hart>::X86ControlFlowContext{
                 pc,
                 next_pc,
                 fallthrough_is_next,
-                &labels
+                &labels,
+                table == blk.jump_tables.end() ? nullptr : &table->second,
+                nullptr,
+                i + 1 < count ? std::optional<uint64_t>{blk.instr_pcs[i + 1]} : std::nullopt
             };
+        };
+
+        const LoopPlan* active_loop = nullptr;
+        bool prev_falls_through = false;
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t pc = blk.instr_pcs[i];
+            const LoopPlan* loop = find_loop(pc);
+            if (loop != active_loop) {
+                if (active_loop != nullptr) {
+                    factory.leave_loop_x86(bb->asmx86.get(), prev_falls_through);
+                }
+                if (loop != nullptr) {
+                    factory.enter_loop_x86(bb->asmx86.get(), *loop);
+                }
+            }
+            if (jump_targets.count(pc) != 0) {
+                factory.begin_region_x86(bb->asmx86.get());
+            }
+            if (loop != nullptr && pc == loop->header_pc) {
+                factory.bind_loop_header_x86(bb->asmx86.get(), labels.at(pc),
+                                             loop == active_loop && prev_falls_through);
+            } else {
+                bb->asmx86->bind(labels.at(pc));
+            }
+            active_loop = loop;
+            const auto ctx = make_ctx(i);
+
+            if (ctx.fallthrough_is_next && jump_targets.count(ctx.next_pc) == 0 &&
+                factory.can_fuse_compare_branch(blk.instrs[i], blk.instrs[i + 1])) {
+                bb->asmx86->bind(labels.at(ctx.next_pc));
+                // The fused branch tests flags, not the compare's result
+                factory.set_dead_rd(dead_rd(blk.instrs[i], ctx.next_pc));
+                factory.compile_fused_compare_branch_x86(bb->asmx86.get(), hart,
+                                                         blk.instrs[i], blk.instrs[i + 1],
+                                                         ctx, make_ctx(i + 1));
+                ++i;
+                prev_falls_through = factory.take_fell_into_target() || make_ctx(i).fallthrough_is_next;
+                continue;
+            }
+            const auto& instr = blk.instrs[i];
+            if (instr.opcode == InstructionOpcode::JAL && instr.rd != 0) {
+                auto callee = blk.inline_callees.find(pc + static_cast<int64_t>(instr.imm));
+                auto ret = labels.find(ctx.next_pc);
+                if (callee != blk.inline_callees.end() && ret != labels.end()) {
+                    factory.set_dead_rd(0);
+                    compile_inline_call_x86(factory, bb->asmx86.get(), hart, instr,
+                                            callee->second, ctx, ret->second);
+                    prev_falls_through = false;
+                    continue;
+                }
+            }
+            factory.set_dead_rd(dead_rd(instr, pc));
             factory.compile_function_x86(bb->asmx86.get(), hart, blk.instrs[i], ctx);
+            prev_falls_through = factory.take_fell_into_target() ||
+                                 (ctx.fallthrough_is_next && FunctionCfg::can_fall_through(blk.instrs[i]));
+        }
+        if (active_loop != nullptr) {
+            factory.leave_loop_x86(bb->asmx86.get(), false);
         }
+        factory.emit_deferred_exits_x86(bb->asmx86.get());
 #else
-        return compile_bb(blk.instrs, hart);
+        return compile_bb(blk.instrs, blk.start_pc, hart);
 #endif
         bb->add_code();
         return bb;
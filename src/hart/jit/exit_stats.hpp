@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace jit {
+
+// Why compiled code handed control back to the dispatcher
+enum class ExitReason : uint8_t {
+    Branch,         // taken branch to a pc outside the block
+    Jump,           // jal or fall-through to a pc outside the block
+    Return,         // ret that is not an inlined callee's
+    IndirectJump,   // jalr without a recognised jump table
+    JumpTable,      // jump table index out of range or to a pc outside the block
+    CallReturn,     // a callee came back to a pc other than the return address
+    Guard,          // trace guard failed
+    Budget,         // instruction budget ran out on a back-edge
+    Ecall,
+    BlockEnd,       // fell off the end of a straight-line block
+};
+
+inline const char* exit_reason_name(ExitReason reason) {
+    switch (reason) {
+        case ExitReason::Branch:       return "branch";
+        case ExitReason::Jump:         return "jump";
+        case ExitReason::Return:       return "return";
+        case ExitReason::IndirectJump: return "indirect-jump";
+        case ExitReason::JumpTable:    return "jump-table";
+        case ExitReason::CallReturn:   return "call-return";
+        case ExitReason::Guard:        return "guard";
+        case ExitReason::Budget:       return "budget";
+        case ExitReason::Ecall:        return "ecall";
+        case ExitReason::BlockEnd:     return "block-end";
+    }
+    return "unknown";
+}
+
+struct ExitSite {
+    uint64_t pc = 0;
+    ExitReason reason = ExitReason::Jump;
+    uint64_t count = 0;
+};
+
+// Exit sites of one compiled block. Compiled code increments count in place,
+// so sites never move once added.
+struct ExitTable {
+    std::deque<ExitSite> sites;
+};
+
+// Exits summed per (pc, reason) over every table, most frequent first.
+inline void write_exit_report(std::ostream& out, const std::vector<std::shared_ptr<ExitTable>>& tables) {
+    std::map<std::pair<uint64_t, ExitReason>, uint64_t> counts;
+    uint64_t total = 0;
+    for (const auto& table : tables) {
+        for (const auto& site : table->sites) {
+            if (site.count != 0) {
+                counts[{site.pc, site.reason}] += site.count;
+                total += site.count;
+            }
+        }
+    }
+    std::vector<std::pair<std::pair<uint64_t, ExitReason>, uint64_t>> sorted(counts.begin(), counts.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    out << "# JIT exits: " << total << " from " << sorted.size() << " sites\n";
+    out << "# count share pc reason\n";
+    for (const auto& [site, count] : sorted) {
+        out << count << ' '
+            << std::fixed << std::setprecision(2) << 100.0 * static_cast<double>(count) / static_cast<double>(total) << "% "
+            << "0x" << std::hex << site.first << std::dec << ' '
+            << exit_reason_name(site.second) << '\n';
+    }
+}
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <iterator>
+#include <memory>
 #include <vector>
 
 #include "jit_instruction_factory.hpp"
@@ -26,6 +28,11 @@ public:
         // Standard function prologue for x86-64 SysV with preserved callee-saved regs.
         asmx86->push(x86::rbp);
         asmx86->mov(x86::rbp, x86::rsp);
+        for (const auto& reg : callee_saved_x86) {
+            asmx86->push(reg);
+        }
+        // Keep rsp 16-byte aligned for calls into trampolines
+        asmx86->sub(x86::rsp, 8);
         exit_label = asmx86->new_label();
 #else
         // Default to AArch64 assembler if unknown architecture at compile time
@@ -40,6 +47,10 @@ public:
 #elif defined(__x86_64__)
         asmx86->bind(exit_label);
         // Epilogue for x86-64 SysV
+        asmx86->add(x86::rsp, 8);
+        for (auto it = std::rbegin(callee_saved_x86); it != std::rend(callee_saved_x86); ++it) {
+            asmx86->pop(*it);
+        }
         asmx86->pop(x86::rbp);
         asmx86->ret();
 #else
@@ -64,7 +75,15 @@ public:
     std::unique_ptr<a64::Assembler> asma64;
     std::unique_ptr<asmjit::x86::Assembler> asmx86;
     asmjit::Label exit_label;
+    // Shared with the exit report so counts outlive the block
+    std::shared_ptr<ExitTable> exit_table = std::make_shared<ExitTable>();
 private:
+#if defined(__x86_64__)
+    // Compiled code keeps its base pointers and pinned guest registers here
+    static inline const x86::Gp callee_saved_x86[] = {
+        x86::rbx, x86::r12, x86::r13, x86::r14, x86::r15
+    };
+#endif
     exec executer;
 };
 
@@ -1,16 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <cassert>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <asmjit/a64.h> 
 #include <asmjit/x86.h> 
 
 #include "decode_execute_module/instruction_opcodes_gen.hpp"
 #include "decode_execute_module/common.hpp"
+#include "memory/memory.hpp"
+#include "exit_stats.hpp"
 
 class Hart;
 
@@ -22,9 +31,15 @@ using namespace asmjit;
 uint64_t memread_trampoline(Hart* hart, uint64_t addr, int size);
 void memwrite_trampoline(Hart* hart, uint64_t addr, uint64_t value, int size);
 uint64_t csrw_trampoline(Hart* hart, uint64_t csr, uint64_t value);
+void sfence_vma_trampoline(Hart* hart, uint64_t va, uint64_t asid, uint64_t scope);
 void ecall_trampoline(Hart* hart);
 void call_trampoline(Hart* hart, uint64_t target_pc, uint64_t return_pc);
 
+// sfence_vma_trampoline scope bits: the fence is limited to one address
+// and/or one address space
+constexpr uint64_t sfence_vma_has_va = 1;
+constexpr uint64_t sfence_vma_has_asid = 2;
+
 template<class Hart>
 class JITFunctionFactory {
     void increase_pc(a64::Assembler* asma64) {
@@ -738,6 +753,7 @@ public:
         memread_func_ptr = (uintptr_t)&::jit::memread_trampoline;
         memwrite_func_ptr = (uintptr_t)&::jit::memwrite_trampoline;
         csrw_func_ptr = (uintptr_t)&::jit::csrw_trampoline;
+        sfence_vma_func_ptr = (uintptr_t)&::jit::sfence_vma_trampoline;
         ecall_func_ptr = (uintptr_t)&::jit::ecall_trampoline;
         call_func_ptr = (uintptr_t)&::jit::call_trampoline;
         exit_label_ = exit_label;
@@ -751,11 +767,13 @@ public:
     }
 
     // x86 constructor
-    JITFunctionFactory(Hart* hart, asmjit::x86::Assembler* asmx86, asmjit::Label* exit_label = nullptr, bool count_instructions = false) {
+    JITFunctionFactory(Hart* hart, asmjit::x86::Assembler* asmx86, asmjit::Label* exit_label = nullptr,
+                       bool count_instructions = false, ExitTable* exit_table = nullptr) {
         // Use trampoline functions (plain function pointers) to avoid C++ pointer-to-member ABI issues
         memread_func_ptr = (uintptr_t)&::jit::memread_trampoline;
         memwrite_func_ptr = (uintptr_t)&::jit::memwrite_trampoline;
         csrw_func_ptr = (uintptr_t)&::jit::csrw_trampoline;
+        sfence_vma_func_ptr = (uintptr_t)&::jit::sfence_vma_trampoline;
         ecall_func_ptr = (uintptr_t)&::jit::ecall_trampoline;
         call_func_ptr = (uintptr_t)&::jit::call_trampoline;
         exit_label_ = exit_label;
@@ -764,14 +782,15 @@ public:
         regs_ptr = (uintptr_t)hart->get_reg_file_begin();
         pc_ptr   = (uintptr_t)hart->get_pc_ptr();
         instr_counter_ptr = (uintptr_t)hart->get_instr_counter_ptr();
+        pc_disp_ = regs_disp(pc_ptr);
+        instr_counter_disp_ = regs_disp(instr_counter_ptr);
+        instr_deadline_disp_ = regs_disp((uintptr_t)hart->get_instr_deadline_ptr());
         count_instructions_ = count_instructions;
+        exit_table_ = exit_table;
+        has_bmi2_ = host_has_bmi2();
 
         // Move constants into chosen registers
-        asmx86->mov(pc_x86_, pc_ptr);
         asmx86->mov(regs_beg_x86_, regs_ptr);
-        if (count_instructions_) {
-            asmx86->mov(instr_counter_x86_, instr_counter_ptr);
-        }
 
         // Detect if paging is disabled (identity mapping) and enable direct memory access fast-path
         direct_mem_access_ = hart->is_paging_disabled();
@@ -779,6 +798,11 @@ public:
         if (direct_mem_access_) {
             mem_backing_ptr_ = hart->get_memory_ptr();
             mem_backing_size_ = hart->get_memory_size();
+            // Addresses past the default RAM size were never checked; a
+            // smaller RAM is, so stray accesses fault instead of leaving it
+            check_mem_bounds_ = mem_backing_size_ < Memory::default_size;
+            // Device registers have to be reached through the hart
+            std::tie(device_lo_, device_hi_) = hart->mmio_hull();
             // Place base pointer to memory in r11 for fast addressing
             asmx86->mov(mem_base_x86_, (uint64_t)mem_backing_ptr_);
             // std::cerr << "JIT x86: Direct memory access enabled. mem_base=0x" << std::hex << (uintptr_t)mem_backing_ptr_ << std::dec << std::endl;
@@ -848,7 +872,8 @@ public:
     void compile(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         assert(asmx86 != nullptr);
         using namespace asmjit::x86;
-        emit_count_x86(asmx86);
+        emit_count_x86();
+        rd_known_ = false;
         switch (instr.opcode) {
             // Arithmetic
             case InstructionOpcode::ADD:   add_x86(asmx86, hart, instr); break;
@@ -922,12 +947,18 @@ public:
             // System
             case InstructionOpcode::ECALL: ecall_x86(asmx86, hart, instr); break;
             case InstructionOpcode::CSRW:  csrw_x86(asmx86, hart, instr); break;
+            case InstructionOpcode::SFENCE_VMA: sfence_vma_x86(asmx86, hart, instr); break;
             
             default:
                 // Fallback: unknown instruction
                 std::cout << "Unsupported op for x86 JIT: " << static_cast<int>(instr.opcode) << std::endl;
                 assert("unknown instr for x86");
         }
+        const bool writes_rd = instr.format == InstructionFormat::R || instr.format == InstructionFormat::I ||
+                               instr.format == InstructionFormat::U || instr.format == InstructionFormat::J;
+        if (writes_rd && !rd_known_ && instr.rd != 0) {
+            known_regs_[instr.rd] = std::nullopt;
+        }
     }
     
     struct X86ControlFlowContext {
@@ -935,6 +966,9 @@ public:
         uint64_t next_pc;
         bool fallthrough_is_next;
         const std::unordered_map<uint64_t, asmjit::Label>* labels;
+        const std::vector<uint64_t>* jump_table = nullptr;   // targets of an indirect jump
+        const asmjit::Label* inline_return = nullptr;        // ret of an inlined leaf lands here
+        std::optional<uint64_t> layout_next_pc = std::nullopt;  // instruction emitted right after this one
     };
 
     void compile_function_x86(asmjit::x86::Assembler* asmx86,
@@ -946,73 +980,68 @@ public:
         assert(ctx.labels != nullptr);
 
         const uint64_t target_pc = ctx.pc + static_cast<int64_t>(instr.imm);
+        static_pc_ = ctx.pc;
 
         switch (instr.opcode) {
             case InstructionOpcode::BEQ:
-                emit_count_x86(asmx86);
-                beq_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
-                return;
             case InstructionOpcode::BNE:
-                emit_count_x86(asmx86);
-                bne_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
-                return;
             case InstructionOpcode::BLT:
-                emit_count_x86(asmx86);
-                blt_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
-                return;
             case InstructionOpcode::BGE:
-                emit_count_x86(asmx86);
-                bge_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
-                return;
             case InstructionOpcode::BLTU:
-                emit_count_x86(asmx86);
-                bltu_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
-                return;
             case InstructionOpcode::BGEU:
-                emit_count_x86(asmx86);
-                bgeu_x86(asmx86, hart, instr);
-                branch_dispatch_x86(asmx86, target_pc, ctx);
+                if (target_pc <= ctx.pc) {
+                    emit_budget_check_x86(asmx86, ctx.pc);
+                }
+                emit_count_x86();
+                branch_dispatch_x86(asmx86, instr, target_pc, ctx);
                 return;
             case InstructionOpcode::JAL:
-                emit_count_x86(asmx86);
+                if (instr.rd != 0 || target_pc <= ctx.pc) {
+                    emit_budget_check_x86(asmx86, ctx.pc);
+                }
+                emit_count_x86();
                 if (instr.rd == 0) {
-                    jal_x86(asmx86, hart, instr);
-                    auto it = ctx.labels->find(target_pc);
-                    if (it != ctx.labels->end()) {
-                        asmx86->jmp(it->second);
-                    } else {
-                        asmx86->jmp(*exit_label_);
-                    }
+                    jump_to_pc_x86(asmx86, target_pc, ctx);
                     return;
                 }
                 jal_x86(asmx86, hart, instr);
+                forget_known_regs();
                 emit_call_trampoline_x86(asmx86, target_pc, ctx.next_pc);
                 emit_post_call_check_x86(asmx86, ctx);
                 return;
             case InstructionOpcode::JALR:
-                emit_count_x86(asmx86);
+                if (instr.rd != 0) {
+                    emit_budget_check_x86(asmx86, ctx.pc);
+                }
+                emit_count_x86();
+                if (is_ret_instruction(instr) && ctx.inline_return != nullptr) {
+                    flush_count_x86(asmx86);
+                    asmx86->jmp(*ctx.inline_return);
+                    return;
+                }
                 if (is_ret_instruction(instr)) {
                     jalr_x86(asmx86, hart, instr);
-                    asmx86->jmp(*exit_label_);
+                    jump_exit_x86(asmx86, ExitReason::Return);
                     return;
                 }
                 if (instr.rd != 0) {
                     jalr_x86(asmx86, hart, instr);
+                    forget_known_regs();
                     emit_call_trampoline_x86(asmx86, std::nullopt, ctx.next_pc);
                     emit_post_call_check_x86(asmx86, ctx);
                     return;
                 }
                 jalr_x86(asmx86, hart, instr);
-                asmx86->jmp(*exit_label_);
+                if (ctx.jump_table != nullptr) {
+                    emit_jump_table_x86(asmx86, *ctx.jump_table, ctx);
+                    return;
+                }
+                jump_exit_x86(asmx86, ExitReason::IndirectJump);
                 return;
             case InstructionOpcode::ECALL:
-                emit_count_x86(asmx86);
+                emit_count_x86();
                 ecall_x86(asmx86, hart, instr);
+                forget_known_regs();
                 return;
             default:
                 break;
@@ -1020,31 +1049,308 @@ public:
 
         compile(asmx86, hart, instr);
         if (!ctx.fallthrough_is_next) {
-            auto it = ctx.labels->find(ctx.next_pc);
-            if (it != ctx.labels->end()) {
-                asmx86->jmp(it->second);
+            jump_to_pc_x86(asmx86, ctx.next_pc, ctx);
+        }
+    }
+
+    // Loads and stores go through helpers that can raise guest exceptions:
+    // every memory access is then a point where the hart observes the state.
+    bool memory_can_fault() const {
+        return !direct_mem_access_;
+    }
+
+    // The next instruction's write to rd is dead: no later instruction reads
+    // it and no exit happens before it is overwritten. 0 for none.
+    void set_dead_rd(uint8_t rd) {
+        dead_rd_ = rd;
+    }
+
+    // Whether the last instruction was a branch that ends by falling into its
+    // taken successor; clears the flag.
+    bool take_fell_into_target() {
+        return std::exchange(fell_into_target_, false);
+    }
+
+    // A jal whose target is compiled right after it: an inlined leaf call or a
+    // jump on a trace. Only the return address is written; an inlined callee's
+    // ret jumps straight back to ctx.next_pc.
+    void begin_inline_call_x86(asmjit::x86::Assembler* asmx86,
+                               const DecodedInstruction& instr,
+                               const X86ControlFlowContext& ctx) {
+        using namespace asmjit::x86;
+        emit_count_x86();
+        write_const_reg_x86(asmx86, instr.rd, ctx.next_pc);
+    }
+
+    // Trace guards: the direction seen while recording falls through to the
+    // next trace instruction, the other one leaves through a side exit.
+    void compile_guarded_branch_x86(asmjit::x86::Assembler* asmx86,
+                                    const DecodedInstruction& instr,
+                                    const X86ControlFlowContext& ctx,
+                                    bool taken) {
+        static_pc_ = ctx.pc;
+        emit_count_x86();
+        flush_count_x86(asmx86);
+        emit_compare_x86(asmx86, instr.rs1, instr.rs2);
+        const BranchCond cond = branch_cond(instr.opcode);
+        const uint64_t other_pc = taken ? ctx.next_pc : ctx.pc + static_cast<int64_t>(instr.imm);
+        asmjit::Label stub = asmx86->new_label();
+        asmx86->j(taken ? cond.not_taken : cond.taken, stub);
+        deferred_exits_.push_back(DeferredExit{stub, other_pc, {}, std::nullopt, ExitReason::Guard});
+    }
+
+    // Indirect jump, call or return on a trace: stays on it only when the
+    // target is the pc seen while recording.
+    void compile_guarded_jalr_x86(asmjit::x86::Assembler* asmx86,
+                                  Hart* hart,
+                                  DecodedInstruction instr,
+                                  const X86ControlFlowContext& ctx,
+                                  uint64_t expected_pc) {
+        using namespace asmjit::x86;
+        static_pc_ = ctx.pc;
+        emit_count_x86();
+        jalr_x86(asmx86, hart, instr);
+        if (instr.rd != 0) {
+            known_regs_[instr.rd] = std::nullopt;
+        }
+        flush_count_x86(asmx86);
+        asmx86->mov(rcx, expected_pc);
+        asmx86->cmp(rax, rcx);
+        asmx86->jne(exit_site_x86(asmx86, ExitReason::Guard));
+    }
+
+    // Closes a trace that came back to its head: a back-edge like any other.
+    void emit_trace_loop_back_x86(asmjit::x86::Assembler* asmx86, uint64_t head_pc,
+                                  const asmjit::Label& head) {
+        emit_budget_check_x86(asmx86, head_pc);
+        asmx86->jmp(head);
+    }
+
+    // Out-of-line exit paths, emitted once after the last instruction of the block.
+    void emit_deferred_exits_x86(asmjit::x86::Assembler* asmx86) {
+        for (const auto& exit : deferred_exits_) {
+            asmx86->bind(exit.label);
+            emit_spill_x86(asmx86, exit.spills);
+            if (exit.target) {
+                asmx86->jmp(*exit.target);
+                continue;
+            }
+            store_pc_x86(asmx86, exit.pc);
+            asmx86->jmp(exit_site_x86(asmx86, exit.reason, exit.pc));
+        }
+        deferred_exits_.clear();
+
+        for (const auto& preheader : deferred_preheaders_) {
+            asmx86->bind(preheader.entry);
+            emit_fill_x86(asmx86, preheader.fills);
+            asmx86->jmp(preheader.loop_head);
+        }
+        deferred_preheaders_.clear();
+
+        // The fast path keeps its pending count, so the stub only lends it to
+        // the hart for the call and takes it back when no exception is raised
+        for (const auto& access : deferred_slow_accesses_) {
+            using namespace asmjit::x86;
+            asmx86->bind(access.label);
+            if (access.pc) {
+                store_pc_x86(asmx86, *access.pc);
+            }
+            if (access.pending_count != 0) {
+                asmx86->add(qword_ptr(regs_beg_x86_, instr_counter_disp_), static_cast<int32_t>(access.pending_count));
+            }
+            emit_spill_x86(asmx86, access.spills);
+            emit_hart_access_x86(asmx86, access.size, access.store, access.sign_extend);
+            if (access.pending_count != 0) {
+                asmx86->sub(qword_ptr(regs_beg_x86_, instr_counter_disp_), static_cast<int32_t>(access.pending_count));
+            }
+            asmx86->jmp(access.resume);
+        }
+        deferred_slow_accesses_.clear();
+
+        if (!deferred_tables_.empty()) {
+            asmx86->align(asmjit::AlignMode::kData, 8);
+        }
+        for (const auto& table : deferred_tables_) {
+            asmx86->bind(table.label);
+            for (const auto& entry : table.entries) {
+                asmx86->embed_label(entry);
+            }
+        }
+        deferred_tables_.clear();
+
+        // Counting stubs go last: the exits above jump to them
+        for (const auto& stub : deferred_site_stubs_) {
+            asmx86->bind(stub.label);
+            asmx86->mov(asmjit::x86::r11, reinterpret_cast<uint64_t>(stub.count));
+            asmx86->inc(asmjit::x86::qword_ptr(asmjit::x86::r11));
+            asmx86->jmp(*exit_label_);
+        }
+        deferred_site_stubs_.clear();
+    }
+
+    // Straight-line blocks end by falling into the exit
+    void emit_block_end_x86(asmjit::x86::Assembler* asmx86) {
+        asmx86->jmp(exit_site_x86(asmx86, ExitReason::BlockEnd));
+        emit_deferred_exits_x86(asmx86);
+    }
+
+    // Instructions of straight-line blocks have no static pc: exit sites are
+    // attributed to the pc given here
+    void set_site_pc(uint64_t pc) {
+        site_pc_ = pc;
+    }
+
+    // Called before binding a PC that other code jumps to: the count of the
+    // region falling through into it must not leak into the jumping paths.
+    void begin_region_x86(asmjit::x86::Assembler* asmx86) {
+        flush_count_x86(asmx86);
+        forget_known_regs();
+    }
+
+    // SLT/SLTU/SLTI/SLTIU followed by BEQ/BNE on its result against x0.
+    static bool can_fuse_compare_branch(const DecodedInstruction& cmp, const DecodedInstruction& br) {
+        switch (cmp.opcode) {
+            case InstructionOpcode::SLT:
+            case InstructionOpcode::SLTU:
+            case InstructionOpcode::SLTI:
+            case InstructionOpcode::SLTIU:
+                break;
+            default:
+                return false;
+        }
+        if (cmp.rd == 0) {
+            return false;
+        }
+        if (br.opcode != InstructionOpcode::BEQ && br.opcode != InstructionOpcode::BNE) {
+            return false;
+        }
+        return (br.rs1 == cmp.rd && br.rs2 == 0) || (br.rs1 == 0 && br.rs2 == cmp.rd);
+    }
+
+    // Emits the set-less-than and branches on the flags of its cmp, so the result
+    // is never reloaded. The caller guarantees the branch is not a jump target.
+    void compile_fused_compare_branch_x86(asmjit::x86::Assembler* asmx86,
+                                          Hart* hart,
+                                          DecodedInstruction cmp,
+                                          DecodedInstruction br,
+                                          const X86ControlFlowContext& cmp_ctx,
+                                          const X86ControlFlowContext& br_ctx) {
+        using namespace asmjit::x86;
+        assert(can_fuse_compare_branch(cmp, br));
+
+        const uint64_t target_pc = br_ctx.pc + static_cast<int64_t>(br.imm);
+        if (target_pc <= br_ctx.pc) {
+            emit_budget_check_x86(asmx86, cmp_ctx.pc);
+        }
+        emit_count_x86();
+        emit_count_x86();
+        flush_count_x86(asmx86);
+
+        static_pc_ = cmp_ctx.pc;
+        const bool is_unsigned = (cmp.opcode == InstructionOpcode::SLTU ||
+                                  cmp.opcode == InstructionOpcode::SLTIU);
+        if (cmp.opcode == InstructionOpcode::SLTI || cmp.opcode == InstructionOpcode::SLTIU) {
+            emit_compare_imm_x86(asmx86, cmp.rs1, cmp.imm);
+        } else {
+            emit_compare_x86(asmx86, cmp.rs1, cmp.rs2);
+        }
+        if (cmp.rd != dead_rd_) {
+            if (is_unsigned) {
+                asmx86->setb(al);
             } else {
-                asmx86->jmp(*exit_label_);
+                asmx86->setl(al);
             }
+            asmx86->movzx(rax, al);
+            write_reg_x86(asmx86, cmp.rd, rax);
+        }
+        if (cmp.rd != 0) {
+            known_regs_[cmp.rd] = std::nullopt;
         }
+
+        static_pc_ = br_ctx.pc;
+        BranchCond cond = is_unsigned ? BranchCond{CondCode::kB, CondCode::kAE}
+                                      : BranchCond{CondCode::kL, CondCode::kGE};
+        if (br.opcode == InstructionOpcode::BEQ) {
+            std::swap(cond.taken, cond.not_taken);
+        }
+        emit_cond_jump_x86(asmx86, cond, target_pc, br_ctx);
     }
-private: 
+
+    // Guest registers kept in callee-saved host registers while compiled code
+    // stays inside an innermost loop of a function block.
+    static constexpr size_t max_pinned_regs = 3;
+
+    struct LoopPlan {
+        uint64_t header_pc = 0;
+        std::unordered_set<uint64_t> pcs;
+        std::vector<uint8_t> pinned;        // guest registers, at most max_pinned_regs
+        uint32_t dirty_mask = 0;            // pinned registers the loop writes
+    };
+
+    // Instructions compiled from here on belong to plan; no code is emitted.
+    // Layout may enter the same loop several times when it is interleaved with
+    // other code, all parts share one loop head.
+    void enter_loop_x86(asmjit::x86::Assembler* asmx86, const LoopPlan& plan) {
+        assert(plan.pinned.size() <= max_pinned_regs);
+        loop_ = &plan;
+        auto it = loop_heads_.find(loop_);
+        if (it == loop_heads_.end()) {
+            it = loop_heads_.emplace(loop_, asmx86->new_label()).first;
+        }
+        loop_head_ = it->second;
+    }
+
+    // Binds the header of the active loop. Entries from outside the loop land on
+    // entry and load the pinned registers; back-edges go straight to the aligned
+    // loop head. When the previous instruction of the loop falls through into
+    // the header, the loads are moved out of line instead.
+    void bind_loop_header_x86(asmjit::x86::Assembler* asmx86,
+                              const asmjit::Label& entry,
+                              bool entered_by_fallthrough) {
+        assert(loop_ != nullptr);
+        if (entered_by_fallthrough) {
+            asmx86->bind(loop_head_);
+            deferred_preheaders_.push_back(DeferredPreheader{entry, loop_head_, pinned_regs_x86()});
+            return;
+        }
+        asmx86->bind(entry);
+        emit_fill_x86(asmx86, pinned_regs_x86());
+        asmx86->align(asmjit::AlignMode::kCode, 16);
+        asmx86->bind(loop_head_);
+    }
+
+    // Called when layout moves past the active loop; falls_out is set when the
+    // last loop instruction continues into the next one in layout.
+    void leave_loop_x86(asmjit::x86::Assembler* asmx86, bool falls_out) {
+        assert(loop_ != nullptr);
+        if (falls_out) {
+            flush_count_x86(asmx86);
+            emit_spill_x86(asmx86, dirty_regs_x86());
+        }
+        loop_ = nullptr;
+    }
+private:
     // Use plain function pointer trampolines to avoid pointer-to-member ABI complexities
     using mem_read_fn  = uint64_t (*)(Hart*, uint64_t, int);
     using mem_write_fn = void     (*)(Hart*, uint64_t, uint64_t, int);
 
+    using PinnedRegs = std::vector<std::pair<uint8_t, asmjit::x86::Gp>>;
+
     // AArch64 registers used in original implementation
     a64::Gp   pc_       = a64::x28;
     a64::Gp   regs_beg_ = a64::x27;
 
-    // x86-64 registers for JIT
-    asmjit::x86::Gp pc_x86_ = asmjit::x86::r13;
+    // x86-64 registers for JIT; pc and the instruction counter are addressed
+    // off the register file, which lives in the same Hart object
     asmjit::x86::Gp regs_beg_x86_ = asmjit::x86::r12;
-    asmjit::x86::Gp instr_counter_x86_ = asmjit::x86::r15;
+    const asmjit::x86::Gp pin_regs_x86_[max_pinned_regs] = {
+        asmjit::x86::rbx, asmjit::x86::r13, asmjit::x86::r15
+    };
 
     uintptr_t memread_func_ptr;
     uintptr_t memwrite_func_ptr;
     uintptr_t csrw_func_ptr;
+    uintptr_t sfence_vma_func_ptr;
     uintptr_t ecall_func_ptr;
     uintptr_t call_func_ptr;
     asmjit::Label* exit_label_ = nullptr;
@@ -1053,12 +1359,87 @@ private:
     bool direct_mem_access_ = false;
     uint8_t* mem_backing_ptr_ = nullptr;
     size_t mem_backing_size_ = 0;
+    bool check_mem_bounds_ = false;
+    uint64_t device_lo_ = 0;    // hull of the MMIO devices, empty with none
+    uint64_t device_hi_ = 0;
     asmjit::x86::Gp mem_base_x86_ = asmjit::x86::r14; // holds base of physical memory
     uintptr_t hart_ptr;
     uintptr_t regs_ptr;
     uintptr_t pc_ptr;
     uintptr_t instr_counter_ptr = 0;
+    int32_t pc_disp_ = 0;
+    int32_t instr_counter_disp_ = 0;
+    int32_t instr_deadline_disp_ = 0;
     bool count_instructions_ = false;
+    bool has_bmi2_ = false;
+    uint32_t pending_count_ = 0;
+    bool fell_into_target_ = false;   // last branch falls into its taken successor
+
+    const LoopPlan* loop_ = nullptr;
+    asmjit::Label loop_head_;
+    std::unordered_map<const LoopPlan*, asmjit::Label> loop_heads_;
+
+    // Side exit metadata: where the guest state differs from the hart at this
+    // point. The pc is a compile-time constant and spills lists the guest
+    // registers that live in host registers; the stub writes both back before
+    // leaving, so the hart resumes at pc with an exact state.
+    struct DeferredExit {
+        asmjit::Label label;
+        uint64_t pc;
+        PinnedRegs spills;
+        std::optional<asmjit::Label> target;    // in-block continuation, else leave at pc
+        ExitReason reason;
+    };
+    std::vector<DeferredExit> deferred_exits_;
+
+    // Exit counters: each site leaves through a stub that bumps its count
+    ExitTable* exit_table_ = nullptr;
+    struct DeferredSiteStub {
+        asmjit::Label label;
+        uint64_t* count;
+    };
+    std::vector<DeferredSiteStub> deferred_site_stubs_;
+    uint64_t site_pc_ = 0;
+
+    struct DeferredPreheader {
+        asmjit::Label entry;
+        asmjit::Label loop_head;
+        PinnedRegs fills;
+    };
+    std::vector<DeferredPreheader> deferred_preheaders_;
+
+    // Direct access whose address failed the guard: the hart performs it,
+    // after the stub syncs the guest state like sync_guest_state_x86 does
+    struct DeferredSlowAccess {
+        asmjit::Label label;
+        asmjit::Label resume;
+        uint32_t size;
+        bool store;
+        bool sign_extend;
+        std::optional<uint64_t> pc;     // static pc of the access, else *pc is current
+        uint32_t pending_count;
+        PinnedRegs spills;
+    };
+    std::vector<DeferredSlowAccess> deferred_slow_accesses_;
+
+    static constexpr uint64_t max_jump_table_span = 4 * 4096;
+
+    // Native jump table: entry k holds the label of lo + 4 * k
+    struct DeferredTable {
+        asmjit::Label label;
+        std::vector<asmjit::Label> entries;
+    };
+    std::vector<DeferredTable> deferred_tables_;
+    std::optional<uint64_t> static_pc_;
+    std::array<std::optional<uint64_t>, 32> known_regs_{};
+    bool rd_known_ = false;     // the instruction being compiled recorded its result
+    uint8_t dead_rd_ = 0;
+
+    // Checked once per process.
+    static bool host_has_bmi2() {
+        static const bool has_bmi2 = __builtin_cpu_supports("bmi2");
+        return has_bmi2;
+    }
 
     bool is_ret_instruction(const DecodedInstruction& instr) const {
         return instr.opcode == InstructionOpcode::JALR &&
@@ -1067,32 +1448,135 @@ private:
                instr.imm == 0;
     }
 
-    void branch_dispatch_x86(asmjit::x86::Assembler* asmx86,
-                             uint64_t target_pc,
-                             const X86ControlFlowContext& ctx) {
+    struct BranchCond {
+        asmjit::x86::CondCode taken;
+        asmjit::x86::CondCode not_taken;
+    };
+
+    static BranchCond branch_cond(InstructionOpcode opcode) {
+        using asmjit::x86::CondCode;
+        switch (opcode) {
+            case InstructionOpcode::BEQ:  return {CondCode::kE,  CondCode::kNE};
+            case InstructionOpcode::BNE:  return {CondCode::kNE, CondCode::kE};
+            case InstructionOpcode::BLT:  return {CondCode::kL,  CondCode::kGE};
+            case InstructionOpcode::BGE:  return {CondCode::kGE, CondCode::kL};
+            case InstructionOpcode::BLTU: return {CondCode::kB,  CondCode::kAE};
+            case InstructionOpcode::BGEU: return {CondCode::kAE, CondCode::kB};
+            default:
+                assert(false && "not a branch");
+                return {CondCode::kE, CondCode::kNE};
+        }
+    }
+
+    // Sets flags for regs[rs1] <=> regs[rs2]; x0 is read as zero.
+    void emit_compare_x86(asmjit::x86::Assembler* asmx86, uint8_t rs1, uint8_t rs2) {
         using namespace asmjit::x86;
-        auto target_it = ctx.labels->find(target_pc);
-        auto fall_it = ctx.labels->find(ctx.next_pc);
-        if (target_it == ctx.labels->end() || fall_it == ctx.labels->end()) {
-            asmx86->jmp(*exit_label_);
+        read_reg_x86(asmx86, rax, rs1);
+        if (rs2 == 0) {
+            asmx86->test(rax, rax);
+        } else if (auto host = pinned_host_x86(rs2)) {
+            asmx86->cmp(rax, *host);
+        } else {
+            asmx86->cmp(rax, ptr(regs_beg_x86_, rs2 * 8));
+        }
+    }
+
+    void emit_compare_imm_x86(asmjit::x86::Assembler* asmx86, uint8_t rs1, int32_t imm) {
+        using namespace asmjit::x86;
+        read_reg_x86(asmx86, rax, rs1);
+        asmx86->cmp(rax, imm);
+    }
+
+    bool leaves_loop(uint64_t pc) const {
+        return loop_ != nullptr && loop_->pcs.count(pc) == 0;
+    }
+
+    // Inside the active loop the header is reached through the loop head, past
+    // the loads of its preheader.
+    std::optional<asmjit::Label> target_label(uint64_t pc, const X86ControlFlowContext& ctx) const {
+        if (loop_ != nullptr && pc == loop_->header_pc) {
+            return loop_head_;
+        }
+        auto it = ctx.labels->find(pc);
+        if (it == ctx.labels->end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Leaves compiled code for pc when it has no label in this block.
+    void jump_to_pc_x86(asmjit::x86::Assembler* asmx86,
+                        uint64_t pc,
+                        const X86ControlFlowContext& ctx) {
+        flush_count_x86(asmx86);
+        if (leaves_loop(pc)) {
+            emit_spill_x86(asmx86, dirty_regs_x86());
+        }
+        if (auto target = target_label(pc, ctx)) {
+            asmx86->jmp(*target);
             return;
         }
-        asmx86->mov(rax, ptr(pc_x86_));
-        asmx86->mov(rcx, target_pc);
-        asmx86->cmp(rax, rcx);
-        asmx86->je(target_it->second);
-        asmx86->jmp(fall_it->second);
+        store_pc_x86(asmx86, pc);
+        asmx86->jmp(exit_site_x86(asmx86, ExitReason::Jump));
+    }
+
+    // Consumes the flags set by the caller: jcc straight to the target label,
+    // then the not-taken path. The region count must already be flushed.
+    void emit_cond_jump_x86(asmjit::x86::Assembler* asmx86,
+                            BranchCond cond,
+                            uint64_t target_pc,
+                            const X86ControlFlowContext& ctx) {
+        assert(pending_count_ == 0);
+        auto target = target_label(target_pc, ctx);
+        if (!ctx.fallthrough_is_next && ctx.layout_next_pc == target_pc && target &&
+            !leaves_loop(target_pc) && !leaves_loop(ctx.next_pc)) {
+            // The taken successor is laid out next: branch away on the
+            // inverted condition and fall into it
+            if (auto not_taken = target_label(ctx.next_pc, ctx)) {
+                asmx86->j(cond.not_taken, *not_taken);
+                fell_into_target_ = true;
+                return;
+            }
+        }
+        if (leaves_loop(target_pc)) {
+            // Loop exit: the spill stub keeps the staying path a not-taken jcc
+            asmjit::Label stub = asmx86->new_label();
+            asmx86->j(cond.taken, stub);
+            deferred_exits_.push_back(DeferredExit{stub, target_pc, dirty_regs_x86(), target, ExitReason::Branch});
+        } else if (target) {
+            asmx86->j(cond.taken, *target);
+        } else {
+            asmjit::Label not_taken = asmx86->new_label();
+            asmx86->j(cond.not_taken, not_taken);
+            store_pc_x86(asmx86, target_pc);
+            asmx86->jmp(exit_site_x86(asmx86, ExitReason::Branch));
+            asmx86->bind(not_taken);
+        }
+
+        if (!ctx.fallthrough_is_next) {
+            jump_to_pc_x86(asmx86, ctx.next_pc, ctx);
+        }
+    }
+
+    void branch_dispatch_x86(asmjit::x86::Assembler* asmx86,
+                             const DecodedInstruction& instr,
+                             uint64_t target_pc,
+                             const X86ControlFlowContext& ctx) {
+        flush_count_x86(asmx86);
+        emit_compare_x86(asmx86, instr.rs1, instr.rs2);
+        emit_cond_jump_x86(asmx86, branch_cond(instr.opcode), target_pc, ctx);
     }
 
     void emit_call_trampoline_x86(asmjit::x86::Assembler* asmx86,
                                   std::optional<uint64_t> target_pc,
                                   uint64_t return_pc) {
         using namespace asmjit::x86;
+        flush_count_x86(asmx86);
         asmx86->mov(rdi, (uint64_t)hart_ptr);
         if (target_pc.has_value()) {
             asmx86->mov(rsi, target_pc.value());
         } else {
-            asmx86->mov(rsi, ptr(pc_x86_));
+            asmx86->mov(rsi, pc_mem_x86());
         }
         asmx86->mov(rdx, return_pc);
         asmx86->mov(rax, (uint64_t)call_func_ptr);
@@ -1102,49 +1586,539 @@ private:
     void emit_post_call_check_x86(asmjit::x86::Assembler* asmx86,
                                   const X86ControlFlowContext& ctx) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, ctx.next_pc);
         asmx86->cmp(rax, rcx);
-        asmx86->jne(*exit_label_);
+        asmx86->jne(exit_site_x86(asmx86, ExitReason::CallReturn));
         if (!ctx.fallthrough_is_next) {
-            auto it = ctx.labels->find(ctx.next_pc);
-            if (it != ctx.labels->end()) {
-                asmx86->jmp(it->second);
+            jump_to_pc_x86(asmx86, ctx.next_pc, ctx);
+        }
+    }
+
+    std::optional<asmjit::x86::Gp> pinned_host_x86(uint8_t reg) const {
+        if (loop_ == nullptr) {
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < loop_->pinned.size(); ++i) {
+            if (loop_->pinned[i] == reg) {
+                return pin_regs_x86_[i];
+            }
+        }
+        return std::nullopt;
+    }
+
+    PinnedRegs pinned_regs_x86() const {
+        PinnedRegs regs;
+        if (loop_ != nullptr) {
+            for (size_t i = 0; i < loop_->pinned.size(); ++i) {
+                regs.emplace_back(loop_->pinned[i], pin_regs_x86_[i]);
+            }
+        }
+        return regs;
+    }
+
+    PinnedRegs dirty_regs_x86() const {
+        PinnedRegs regs = pinned_regs_x86();
+        regs.erase(std::remove_if(regs.begin(), regs.end(), [&](const auto& reg) {
+            return (loop_->dirty_mask & (1u << reg.first)) == 0;
+        }), regs.end());
+        return regs;
+    }
+
+    void emit_fill_x86(asmjit::x86::Assembler* asmx86, const PinnedRegs& regs) {
+        for (const auto& [guest, host] : regs) {
+            asmx86->mov(host, asmjit::x86::ptr(regs_beg_x86_, guest * 8));
+        }
+    }
+
+    void emit_spill_x86(asmjit::x86::Assembler* asmx86, const PinnedRegs& regs) {
+        for (const auto& [guest, host] : regs) {
+            asmx86->mov(asmjit::x86::ptr(regs_beg_x86_, guest * 8), host);
+        }
+    }
+
+    // Guest memory operand of a load or store in direct mode: mem_base + rs1 +
+    // imm as one addressing mode. When the region knows rs1, an address inside
+    // guest memory is resolved at compile time to [mem_base + disp32].
+    asmjit::x86::Mem guest_mem_x86(asmjit::x86::Assembler* asmx86, const DecodedInstruction& instr,
+                                   uint32_t size) {
+        using namespace asmjit::x86;
+        if (auto base = known_reg(instr.rs1)) {
+            const uint64_t addr = *base + static_cast<int64_t>(instr.imm);
+            if (addr <= static_cast<uint64_t>(INT32_MAX) && addr + size <= mem_backing_size_) {
+                return sized_ptr_x86(mem_base_x86_, static_cast<int32_t>(addr), size);
+            }
+        }
+        const Gp base = reg_operand_x86(asmx86, instr.rs1, r10);
+        switch (size) {
+            case 1:  return byte_ptr(mem_base_x86_, base, 0, instr.imm);
+            case 2:  return word_ptr(mem_base_x86_, base, 0, instr.imm);
+            case 4:  return dword_ptr(mem_base_x86_, base, 0, instr.imm);
+            default: return qword_ptr(mem_base_x86_, base, 0, instr.imm);
+        }
+    }
+
+    static asmjit::x86::Mem sized_ptr_x86(const asmjit::x86::Gp& base, const asmjit::x86::Gp& index,
+                                          uint32_t size) {
+        using namespace asmjit::x86;
+        switch (size) {
+            case 1:  return byte_ptr(base, index);
+            case 2:  return word_ptr(base, index);
+            case 4:  return dword_ptr(base, index);
+            default: return qword_ptr(base, index);
+        }
+    }
+
+    static asmjit::x86::Mem sized_ptr_x86(const asmjit::x86::Gp& base, int32_t disp, uint32_t size) {
+        using namespace asmjit::x86;
+        switch (size) {
+            case 1:  return byte_ptr(base, disp);
+            case 2:  return word_ptr(base, disp);
+            case 4:  return dword_ptr(base, disp);
+            default: return qword_ptr(base, disp);
+        }
+    }
+
+    // Whether size bytes at guest address addr are RAM the JIT may touch in
+    // place: inside guest memory and clear of the device hull
+    bool direct_addr_ok(uint64_t addr, uint32_t size) const {
+        return addr <= mem_backing_size_ && size <= mem_backing_size_ - addr &&
+               !(addr < device_hi_ && addr + size > device_lo_);
+    }
+
+    // Branches to slow unless the size bytes at the address in r10 pass
+    // direct_addr_ok. The device test is Bus::find's hull check with the hull
+    // widened down by size - 1, so accesses running into it are caught too.
+    // Clobbers r11 and rax.
+    void emit_direct_guard_x86(asmjit::x86::Assembler* asmx86, uint32_t size, const asmjit::Label& slow) {
+        using namespace asmjit::x86;
+        if (check_mem_bounds_) {
+            asmx86->mov(r11, mem_backing_size_ - size);
+            asmx86->cmp(r10, r11);
+            asmx86->ja(slow);
+        }
+        if (device_lo_ != device_hi_) {
+            const uint64_t lo = device_lo_ - (size - 1);
+            asmx86->mov(r11, -lo);
+            asmx86->add(r11, r10);
+            asmx86->mov(rax, device_hi_ - lo);
+            asmx86->cmp(r11, rax);
+            asmx86->jb(slow);
+        }
+    }
+
+    bool direct_access_guarded() const {
+        return check_mem_bounds_ || device_lo_ != device_hi_;
+    }
+
+    // rax = the size bytes at src, extended to 64 bits as the load requires
+    template<typename Src>
+    void emit_load_extend_x86(asmjit::x86::Assembler* asmx86, const Src& src, uint32_t size, bool sign_extend) {
+        using namespace asmjit::x86;
+        switch (size) {
+            case 1:
+            case 2:
+                if (sign_extend) {
+                    asmx86->movsx(rax, src);
+                } else {
+                    asmx86->movzx(rax, src);
+                }
+                break;
+            case 4:
+                if (sign_extend) {
+                    asmx86->movsxd(rax, src);
+                } else {
+                    asmx86->mov(eax, src);
+                }
+                break;
+            default:
+                asmx86->mov(rax, src);
+                break;
+        }
+    }
+
+    // Load or store at the address in r10 through the hart; a store takes its
+    // value from rdx, a load leaves it in rax.
+    void emit_hart_access_x86(asmjit::x86::Assembler* asmx86, uint32_t size, bool store, bool sign_extend) {
+        using namespace asmjit::x86;
+        asmx86->mov(rdi, (uint64_t)hart_ptr);
+        asmx86->mov(rsi, r10);
+        asmx86->mov(store ? rcx : rdx, size);
+        asmx86->mov(rax, (uint64_t)(store ? memwrite_func_ptr : memread_func_ptr));
+        asmx86->call(rax);
+        if (store) {
+            return;
+        }
+        switch (size) {
+            case 1:  emit_load_extend_x86(asmx86, al, size, sign_extend); break;
+            case 2:  emit_load_extend_x86(asmx86, ax, size, sign_extend); break;
+            case 4:  emit_load_extend_x86(asmx86, eax, size, sign_extend); break;
+            default: break;
+        }
+    }
+
+    // Direct-mode load of rs1 + imm into rax. When accesses are guarded the
+    // address goes to r10 and anything outside direct_addr_ok branches out of
+    // line to the hart.
+    void emit_direct_load_x86(asmjit::x86::Assembler* asmx86, const DecodedInstruction& instr,
+                              uint32_t size, bool sign_extend) {
+        using namespace asmjit::x86;
+        if (!direct_access_guarded()) {
+            emit_load_extend_x86(asmx86, guest_mem_x86(asmx86, instr, size), size, sign_extend);
+            return;
+        }
+        emit_guarded_access_x86(asmx86, instr, size, false, sign_extend, [&](const Mem& mem) {
+            emit_load_extend_x86(asmx86, mem, size, sign_extend);
+        });
+    }
+
+    // Direct-mode store of rdx to rs1 + imm, guarded like emit_direct_load_x86
+    void emit_direct_store_x86(asmjit::x86::Assembler* asmx86, const DecodedInstruction& instr, uint32_t size) {
+        using namespace asmjit::x86;
+        auto store = [&](const Mem& mem) {
+            switch (size) {
+                case 1:  asmx86->mov(mem, dl); break;
+                case 2:  asmx86->mov(mem, dx); break;
+                case 4:  asmx86->mov(mem, edx); break;
+                default: asmx86->mov(mem, rdx); break;
+            }
+        };
+        if (!direct_access_guarded()) {
+            store(guest_mem_x86(asmx86, instr, size));
+            return;
+        }
+        emit_guarded_access_x86(asmx86, instr, size, true, false, store);
+    }
+
+    template<typename Access>
+    void emit_guarded_access_x86(asmjit::x86::Assembler* asmx86, const DecodedInstruction& instr,
+                                 uint32_t size, bool store, bool sign_extend, Access&& access) {
+        using namespace asmjit::x86;
+        if (auto base = known_reg(instr.rs1)) {
+            const uint64_t addr = *base + static_cast<int64_t>(instr.imm);
+            if (addr <= static_cast<uint64_t>(INT32_MAX) && direct_addr_ok(addr, size)) {
+                access(sized_ptr_x86(mem_base_x86_, static_cast<int32_t>(addr), size));
             } else {
-                asmx86->jmp(*exit_label_);
+                sync_guest_state_x86(asmx86);
+                asmx86->mov(r10, addr);
+                emit_hart_access_x86(asmx86, size, store, sign_extend);
             }
+            return;
+        }
+        emit_guest_addr_x86(asmx86, r10, instr);
+        const asmjit::Label slow = asmx86->new_label();
+        const asmjit::Label resume = asmx86->new_label();
+        emit_direct_guard_x86(asmx86, size, slow);
+        access(sized_ptr_x86(mem_base_x86_, r10, size));
+        asmx86->bind(resume);
+        deferred_slow_accesses_.push_back(DeferredSlowAccess{slow, resume, size, store, sign_extend, static_pc_,
+                                                             pending_count_, loop_ ? dirty_regs_x86() : PinnedRegs{}});
+    }
+
+    // dst = rs1 + imm, the guest address of a load or store.
+    void emit_guest_addr_x86(asmjit::x86::Assembler* asmx86, const asmjit::x86::Gp& dst,
+                             const DecodedInstruction& instr) {
+        if (auto base = known_reg(instr.rs1)) {
+            asmx86->mov(dst, *base + static_cast<int64_t>(instr.imm));
+            return;
+        }
+        read_reg_x86(asmx86, dst, instr.rs1);
+        if (instr.imm != 0) {
+            asmx86->add(dst, static_cast<int64_t>(instr.imm));
         }
     }
 
-    void write_reg_x86(asmjit::x86::Assembler* asmx86, uint8_t rd, const asmjit::x86::Gp& value) {
+    // Register values known at compile time within the current straight-line
+    // region: set by lui, auipc and addi of known values, dropped on any other
+    // write and at every point other code can jump to.
+    std::optional<uint64_t> known_reg(uint8_t reg) const {
+        if (reg == 0) {
+            return 0;
+        }
+        return known_regs_[reg];
+    }
+
+    void set_known_reg(uint8_t reg, uint64_t value) {
+        if (reg != 0) {
+            known_regs_[reg] = value;
+            rd_known_ = true;
+        }
+    }
+
+    void forget_known_regs() {
+        known_regs_.fill(std::nullopt);
+    }
+
+    // rd = value, as a sign-extended 32-bit immediate store where it fits.
+    void write_const_reg_x86(asmjit::x86::Assembler* asmx86, uint8_t rd, uint64_t value) {
+        using namespace asmjit::x86;
         if (rd == 0) {
             return;
         }
+        if (rd == dead_rd_) {
+            set_known_reg(rd, value);
+            return;
+        }
+        const int64_t v = static_cast<int64_t>(value);
+        if (pinned_host_x86(rd) || v < INT32_MIN || v > INT32_MAX) {
+            asmx86->mov(rax, value);
+            write_reg_x86(asmx86, rd, rax);
+        } else {
+            asmx86->mov(qword_ptr(regs_beg_x86_, rd * 8), static_cast<int32_t>(v));
+        }
+        set_known_reg(rd, value);
+    }
+
+    // x0 reads as zero; a pinned register is read from its host register.
+    void read_reg_x86(asmjit::x86::Assembler* asmx86, const asmjit::x86::Gp& dst, uint8_t reg) {
+        if (reg == 0) {
+            asmx86->xor_(dst.r32(), dst.r32());
+        } else if (auto host = pinned_host_x86(reg)) {
+            asmx86->mov(dst, *host);
+        } else {
+            asmx86->mov(dst, asmjit::x86::ptr(regs_beg_x86_, reg * 8));
+        }
+    }
+
+    void read_reg32_x86(asmjit::x86::Assembler* asmx86, const asmjit::x86::Gp& dst, uint8_t reg) {
+        if (reg == 0) {
+            asmx86->xor_(dst, dst);
+        } else if (auto host = pinned_host_x86(reg)) {
+            asmx86->mov(dst, host->r32());
+        } else {
+            asmx86->mov(dst, asmjit::x86::dword_ptr(regs_beg_x86_, reg * 8));
+        }
+    }
+
+    // Host register holding reg for use as a source operand: its pinned
+    // register, or scratch loaded from the register file.
+    asmjit::x86::Gp reg_operand_x86(asmjit::x86::Assembler* asmx86, uint8_t reg,
+                                    const asmjit::x86::Gp& scratch) {
+        if (auto host = pinned_host_x86(reg)) {
+            return *host;
+        }
+        read_reg_x86(asmx86, scratch, reg);
+        return scratch;
+    }
+
+    void write_reg_x86(asmjit::x86::Assembler* asmx86, uint8_t rd, const asmjit::x86::Gp& value) {
+        if (rd == 0 || rd == dead_rd_) {
+            return;
+        }
+        if (auto host = pinned_host_x86(rd)) {
+            asmx86->mov(*host, value);
+            return;
+        }
         asmx86->mov(asmjit::x86::ptr(regs_beg_x86_, rd * 8), value);
     }
 
-    void emit_count_x86(asmjit::x86::Assembler* asmx86) {
+    int32_t regs_disp(uintptr_t field) const {
+        const intptr_t disp = (intptr_t)field - (intptr_t)regs_ptr;
+        assert(disp >= INT32_MIN && disp <= INT32_MAX);
+        return static_cast<int32_t>(disp);
+    }
+
+    asmjit::x86::Mem pc_mem_x86() const {
+        return asmjit::x86::qword_ptr(regs_beg_x86_, pc_disp_);
+    }
+
+    // Instructions are counted at compile time and added to the counter once
+    // per straight-line region, right before control can leave it.
+    void emit_count_x86() {
         if (!count_instructions_) {
             return;
         }
-        asmx86->inc(asmjit::x86::qword_ptr(instr_counter_x86_));
+        ++pending_count_;
+    }
+
+    // Clobbers flags: must precede the compare of a conditional branch.
+    void flush_count_x86(asmjit::x86::Assembler* asmx86) {
+        if (pending_count_ == 0) {
+            return;
+        }
+        asmx86->add(asmjit::x86::qword_ptr(regs_beg_x86_, instr_counter_disp_), static_cast<int32_t>(pending_count_));
+        pending_count_ = 0;
+    }
+
+    // Placed in front of back-edges and calls, before the instruction at pc is
+    // counted: leaves compiled code at pc once the hart's deadline is reached.
+    void emit_budget_check_x86(asmjit::x86::Assembler* asmx86, uint64_t pc) {
+        using namespace asmjit::x86;
+        if (!count_instructions_) {
+            return;
+        }
+        flush_count_x86(asmx86);
+        asmjit::Label exhausted = asmx86->new_label();
+        asmx86->mov(rax, ptr(regs_beg_x86_, instr_counter_disp_));
+        asmx86->cmp(rax, ptr(regs_beg_x86_, instr_deadline_disp_));
+        asmx86->jae(exhausted);
+        deferred_exits_.push_back(DeferredExit{exhausted, pc, loop_ ? dirty_regs_x86() : PinnedRegs{}, std::nullopt,
+                                              ExitReason::Budget});
+    }
+
+    // Dispatches the target pc in rax (already stored to *pc) through a table
+    // of block labels spanning the lowest to the highest target. Any pc outside
+    // the table or without a label leaves compiled code.
+    void emit_jump_table_x86(asmjit::x86::Assembler* asmx86,
+                             const std::vector<uint64_t>& targets,
+                             const X86ControlFlowContext& ctx) {
+        using namespace asmjit::x86;
+        flush_count_x86(asmx86);
+        const auto [lo_it, hi_it] = std::minmax_element(targets.begin(), targets.end());
+        const uint64_t lo = *lo_it;
+        const uint64_t span = *hi_it - lo;
+        const asmjit::Label miss = exit_site_x86(asmx86, ExitReason::JumpTable);
+        if (span > max_jump_table_span) {
+            asmx86->jmp(miss);
+            return;
+        }
+
+        DeferredTable table{asmx86->new_label(), {}};
+        table.entries.reserve(span / 4 + 1);
+        for (uint64_t off = 0; off <= span; off += 4) {
+            auto target = target_label(lo + off, ctx);
+            table.entries.push_back(target ? *target : miss);
+        }
+
+        asmx86->mov(rcx, lo);
+        asmx86->sub(rax, rcx);
+        asmx86->cmp(rax, static_cast<int32_t>(span));
+        asmx86->ja(miss);
+        asmx86->test(al, 3);
+        asmx86->jnz(miss);
+        asmx86->lea(rcx, ptr(table.label));
+        asmx86->jmp(ptr(rcx, rax, 1));
+        deferred_tables_.push_back(std::move(table));
+    }
+
+    void jump_exit_x86(asmjit::x86::Assembler* asmx86, ExitReason reason) {
+        flush_count_x86(asmx86);
+        asmx86->jmp(exit_site_x86(asmx86, reason));
+    }
+
+    // Where an exit at the current instruction jumps to leave compiled code:
+    // a new counted site when the block keeps an exit table
+    asmjit::Label exit_site_x86(asmjit::x86::Assembler* asmx86, ExitReason reason) {
+        return exit_site_x86(asmx86, reason, static_pc_ ? *static_pc_ : site_pc_);
+    }
+
+    asmjit::Label exit_site_x86(asmjit::x86::Assembler* asmx86, ExitReason reason, uint64_t pc) {
+        if (exit_table_ == nullptr) {
+            return *exit_label_;
+        }
+        exit_table_->sites.push_back(ExitSite{pc, reason, 0});
+        deferred_site_stubs_.push_back(DeferredSiteStub{asmx86->new_label(), &exit_table_->sites.back().count});
+        return deferred_site_stubs_.back().label;
+    }
+
+    // Function blocks know the PC of every instruction at compile time, so *pc
+    // is only written where control can leave compiled code.
+    void store_pc_x86(asmjit::x86::Assembler* asmx86, uint64_t value) {
+        using namespace asmjit::x86;
+        if (value <= static_cast<uint64_t>(INT32_MAX)) {
+            asmx86->mov(pc_mem_x86(), static_cast<int32_t>(value));
+            return;
+        }
+        // r11 keeps rax intact for callers holding an address in it
+        asmx86->mov(r11, value);
+        asmx86->mov(pc_mem_x86(), r11);
+    }
+
+    void load_pc_x86(asmjit::x86::Assembler* asmx86, const asmjit::x86::Gp& dst) {
+        if (static_pc_) {
+            asmx86->mov(dst, *static_pc_);
+        } else {
+            asmx86->mov(dst, pc_mem_x86());
+        }
+    }
+
+    // Makes *pc exact before calling out to C++ code that may report it.
+    void sync_pc_x86(asmjit::x86::Assembler* asmx86) {
+        if (static_pc_) {
+            store_pc_x86(asmx86, *static_pc_);
+        }
+    }
+
+    // Before a helper that can raise a guest exception the hart must see the
+    // exact architectural state of the faulting instruction: its pc, the
+    // instruction count so far and every pinned register written in the loop.
+    // Pinned registers stay valid in their callee-saved host registers.
+    void sync_guest_state_x86(asmjit::x86::Assembler* asmx86) {
+        sync_pc_x86(asmx86);
+        flush_count_x86(asmx86);
+        if (loop_ != nullptr) {
+            emit_spill_x86(asmx86, dirty_regs_x86());
+        }
+    }
+
+    void store_next_pc_x86(asmjit::x86::Assembler* asmx86) {
+        if (static_pc_) {
+            store_pc_x86(asmx86, *static_pc_ + 4);
+        } else {
+            increase_pc(asmx86);
+        }
     }
 
     // --- x86 implementations for common operations ---
     void increase_pc(asmjit::x86::Assembler* asmx86) {
         using namespace asmjit::x86;
+        if (static_pc_) {
+            return;
+        }
         // rax will be used as a temporary here
-        asmx86->mov(rax, asmjit::x86::ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->add(rax, 4);
-        asmx86->mov(asmjit::x86::ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
+    }
+
+    // Register-amount shifts. BMI2 shlx/shrx/sarx take the amount in any
+    // register and mask it like RISC-V does (6 bits, 5 for *W), so pinned
+    // operands are used in place and rcx stays free; otherwise the amount
+    // goes through cl.
+    enum class ShiftOp { Left, Logical, Arith };
+
+    void emit_var_shift_x86(asmjit::x86::Assembler* asmx86, const DecodedInstruction& instr,
+                            ShiftOp op, bool word) {
+        using namespace asmjit::x86;
+        const Gp dst = word ? eax : rax;
+        if (has_bmi2_) {
+            Gp value = reg_operand_x86(asmx86, instr.rs1, rax);
+            Gp amount = reg_operand_x86(asmx86, instr.rs2, rdx);
+            if (word) {
+                value = value.r32();
+                amount = amount.r32();
+            }
+            switch (op) {
+                case ShiftOp::Left:    asmx86->shlx(dst, value, amount); break;
+                case ShiftOp::Logical: asmx86->shrx(dst, value, amount); break;
+                case ShiftOp::Arith:   asmx86->sarx(dst, value, amount); break;
+            }
+        } else {
+            if (word) {
+                read_reg32_x86(asmx86, eax, instr.rs1);
+                read_reg32_x86(asmx86, ecx, instr.rs2);
+            } else {
+                read_reg_x86(asmx86, rax, instr.rs1);
+                read_reg_x86(asmx86, rcx, instr.rs2);
+            }
+            switch (op) {
+                case ShiftOp::Left:    asmx86->shl(dst, cl); break;
+                case ShiftOp::Logical: asmx86->shr(dst, cl); break;
+                case ShiftOp::Arith:   asmx86->sar(dst, cl); break;
+            }
+        }
+        if (word) {
+            asmx86->movsxd(rax, eax);
+        }
+        write_reg_x86(asmx86, instr.rd, rax);
     }
 
     void add_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
         // rax <- regs[rs1]
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         // rdx <- regs[rs2]
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->add(rax, rdx);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1152,8 +2126,8 @@ private:
 
     void sub_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->sub(rax, rdx);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1161,7 +2135,12 @@ private:
 
     void addi_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        if (auto value = known_reg(instr.rs1)) {
+            write_const_reg_x86(asmx86, instr.rd, *value + (int64_t)instr.imm);
+            increase_pc(asmx86);
+            return;
+        }
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->add(rax, (int64_t)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1169,7 +2148,7 @@ private:
 
     void slli_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->shl(rax, (unsigned)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1177,22 +2156,14 @@ private:
 
     void ld_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        // addr = regs[rs1] + imm
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            // rax = physical address
-            // use r10 as temp address = mem_base + rax
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            // load 8 bytes
-            asmx86->mov(rax, ptr(r10));
+            emit_direct_load_x86(asmx86, instr, 8, false);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
             // prepare call: rdi = hart_ptr, rsi = addr, rdx = size
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 8);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1205,21 +2176,15 @@ private:
 
     void sd_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        // addr = regs[rs1] + imm
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-        // value in rdx
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs2);
 
         if (direct_mem_access_) {
-            // write directly: [mem_base + addr] = value
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->mov(ptr(r10), rdx);
+            emit_direct_store_x86(asmx86, instr, 8);
         } else {
             // prepare call: rdi = hart_ptr, rsi = addr, rdx = value, rcx = size
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax); // addr
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rcx, 8);    // size
             asmx86->mov(rax, (uint64_t)memwrite_func_ptr);
             asmx86->call(rax);
@@ -1230,35 +2195,23 @@ private:
 
     // Additional x86 implementations for missing instructions
     void sll_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rcx, ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->shl(rax, cl); // CL register is the only valid shift count register
-        write_reg_x86(asmx86, instr.rd, rax);
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Left, false);
         increase_pc(asmx86);
     }
 
     void srl_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rcx, ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->shr(rax, cl);
-        write_reg_x86(asmx86, instr.rd, rax);
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Logical, false);
         increase_pc(asmx86);
     }
 
     void sra_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rcx, ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->sar(rax, cl);
-        write_reg_x86(asmx86, instr.rd, rax);
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Arith, false);
         increase_pc(asmx86);
     }
 
     void srli_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->shr(rax, (unsigned)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1266,7 +2219,7 @@ private:
 
     void srai_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->sar(rax, (unsigned)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1274,8 +2227,8 @@ private:
 
     void xor_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->xor_(rax, rdx);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1283,7 +2236,7 @@ private:
 
     void xori_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->xor_(rax, (int64_t)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1291,8 +2244,8 @@ private:
 
     void or_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->or_(rax, rdx);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1300,7 +2253,7 @@ private:
 
     void ori_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->or_(rax, (int64_t)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1308,8 +2261,8 @@ private:
 
     void and_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->and_(rax, rdx);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1317,7 +2270,7 @@ private:
 
     void andi_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->and_(rax, (int64_t)instr.imm);
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1325,8 +2278,8 @@ private:
 
     void slt_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->cmp(rax, rdx);
         asmx86->setl(al);  // Set AL if less (signed)
         asmx86->movzx(rax, al); // Zero-extend to 64-bit
@@ -1336,7 +2289,7 @@ private:
 
     void slti_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->cmp(rax, (int64_t)instr.imm);
         asmx86->setl(al);
         asmx86->movzx(rax, al);
@@ -1346,8 +2299,8 @@ private:
 
     void sltu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
         asmx86->cmp(rax, rdx);
         asmx86->setb(al);  // Set AL if below (unsigned)
         asmx86->movzx(rax, al);
@@ -1357,7 +2310,7 @@ private:
 
     void sltiu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->cmp(rax, (uint64_t)instr.imm);
         asmx86->setb(al);
         asmx86->movzx(rax, al);
@@ -1367,17 +2320,13 @@ private:
 
     void lb_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->movsx(rax, byte_ptr(r10));  // Sign-extend byte to 64-bit
+            emit_direct_load_x86(asmx86, instr, 1, true);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 1);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1390,17 +2339,13 @@ private:
 
     void lh_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->movsx(rax, word_ptr(r10));  // Sign-extend word to 64-bit
+            emit_direct_load_x86(asmx86, instr, 2, true);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 2);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1413,17 +2358,13 @@ private:
 
     void lw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->movsxd(rax, dword_ptr(r10));  // Sign-extend dword to 64-bit
+            emit_direct_load_x86(asmx86, instr, 4, true);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 4);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1436,17 +2377,13 @@ private:
 
     void lbu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->movzx(rax, byte_ptr(r10));  // Zero-extend byte to 64-bit
+            emit_direct_load_x86(asmx86, instr, 1, false);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 1);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1459,17 +2396,13 @@ private:
 
     void lhu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->movzx(rax, word_ptr(r10));  // Zero-extend word to 64-bit
+            emit_direct_load_x86(asmx86, instr, 2, false);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 2);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1482,17 +2415,13 @@ private:
 
     void lwu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->mov(eax, dword_ptr(r10));  // Load 32-bit (zero-extends upper 32 bits)
+            emit_direct_load_x86(asmx86, instr, 4, false);
             write_reg_x86(asmx86, instr.rd, rax);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rdx, 4);
             asmx86->mov(rax, (uint64_t)memread_func_ptr);
             asmx86->call(rax);
@@ -1505,17 +2434,14 @@ private:
 
     void sb_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs2);
 
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->mov(byte_ptr(r10), dl);  // Store low byte
+            emit_direct_store_x86(asmx86, instr, 1);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rcx, 1);
             asmx86->mov(rax, (uint64_t)memwrite_func_ptr);
             asmx86->call(rax);
@@ -1526,17 +2452,14 @@ private:
 
     void sh_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs2);
 
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->mov(word_ptr(r10), dx);  // Store low word
+            emit_direct_store_x86(asmx86, instr, 2);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rcx, 2);
             asmx86->mov(rax, (uint64_t)memwrite_func_ptr);
             asmx86->call(rax);
@@ -1547,17 +2470,14 @@ private:
 
     void sw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
-        if (instr.imm != 0)
-            asmx86->add(rax, (int64_t)instr.imm);
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs2);
 
         if (direct_mem_access_) {
-            asmx86->lea(r10, ptr(mem_base_x86_, rax));
-            asmx86->mov(dword_ptr(r10), edx);  // Store low dword
+            emit_direct_store_x86(asmx86, instr, 4);
         } else {
+            sync_guest_state_x86(asmx86);
             asmx86->mov(rdi, (uint64_t)hart_ptr);
-            asmx86->mov(rsi, rax);
+            emit_guest_addr_x86(asmx86, rsi, instr);
             asmx86->mov(rcx, 4);
             asmx86->mov(rax, (uint64_t)memwrite_func_ptr);
             asmx86->call(rax);
@@ -1567,15 +2487,17 @@ private:
     }
 
     void lui_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(rax, (int64_t)instr.imm << 12);
-        write_reg_x86(asmx86, instr.rd, rax);
+        write_const_reg_x86(asmx86, instr.rd, static_cast<uint64_t>((int64_t)instr.imm << 12));
         increase_pc(asmx86);
     }
 
     void auipc_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        if (static_pc_) {
+            write_const_reg_x86(asmx86, instr.rd, *static_pc_ + ((int64_t)instr.imm << 12));
+            return;
+        }
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->add(rax, ((int64_t)instr.imm << 12));
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
@@ -1583,118 +2505,126 @@ private:
 
     void jal_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        if (static_pc_) {
+            asmx86->mov(rax, *static_pc_ + 4);
+            write_reg_x86(asmx86, instr.rd, rax);  // Store return address
+            store_pc_x86(asmx86, *static_pc_ + (int64_t)instr.imm);
+            return;
+        }
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->add(rax, 4);
         write_reg_x86(asmx86, instr.rd, rax);  // Store return address
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->add(rax, (int64_t)instr.imm);
-        asmx86->mov(ptr(pc_x86_), rax);  // Set PC to new address
+        asmx86->mov(pc_mem_x86(), rax);  // Set PC to new address
     }
 
     void jalr_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        // rs1 is read first: rd may alias it
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        load_pc_x86(asmx86, rax);
         asmx86->add(rax, 4);
         write_reg_x86(asmx86, instr.rd, rax);  // Store return address
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        asmx86->mov(rax, rdx);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->and_(rax, (int64_t)-2);
-        asmx86->mov(ptr(pc_x86_), rax);  // Set PC to rs1 + imm
+        asmx86->mov(pc_mem_x86(), rax);  // Set PC to rs1 + imm
     }
 
     void beq_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmovne(rax, rcx); // If not equal, use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void bne_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmove(rax, rcx);   // If equal, use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void blt_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmovge(rax, rcx);  // If greater/equal, use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void bge_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmovl(rax, rcx);   // If less, use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void bltu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmovae(rax, rcx);  // If above/equal (unsigned), use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void bgeu_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(pc_x86_));
+        asmx86->mov(rax, pc_mem_x86());
         asmx86->mov(rcx, rax);
         asmx86->add(rax, (int64_t)instr.imm);
         asmx86->add(rcx, 4);
 
-        asmx86->mov(rdx, ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(r8, ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg_x86(asmx86, rdx, instr.rs1);
+        read_reg_x86(asmx86, r8, instr.rs2);
         asmx86->cmp(rdx, r8);
 
         asmx86->cmovb(rax, rcx);   // If below (unsigned), use fall-through
-        asmx86->mov(ptr(pc_x86_), rax);
+        asmx86->mov(pc_mem_x86(), rax);
     }
 
     void addiw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));  // Load 32-bit value
+        read_reg32_x86(asmx86, eax, instr.rs1);
         asmx86->add(eax, (int32_t)instr.imm);
         asmx86->movsxd(rax, eax);  // Sign-extend to 64-bit
         write_reg_x86(asmx86, instr.rd, rax);
@@ -1703,8 +2633,8 @@ private:
 
     void addw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(edx, dword_ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg32_x86(asmx86, eax, instr.rs1);
+        read_reg32_x86(asmx86, edx, instr.rs2);
         asmx86->add(eax, edx);
         asmx86->movsxd(rax, eax);  // Sign-extend to 64-bit
         write_reg_x86(asmx86, instr.rd, rax);
@@ -1713,8 +2643,8 @@ private:
 
     void subw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(edx, dword_ptr(regs_beg_x86_, instr.rs2 * 8));
+        read_reg32_x86(asmx86, eax, instr.rs1);
+        read_reg32_x86(asmx86, edx, instr.rs2);
         asmx86->sub(eax, edx);
         asmx86->movsxd(rax, eax);
         write_reg_x86(asmx86, instr.rd, rax);
@@ -1722,37 +2652,23 @@ private:
     }
 
     void sllw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(ecx, dword_ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->shl(eax, cl);
-        asmx86->movsxd(rax, eax);
-        write_reg_x86(asmx86, instr.rd, rax);
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Left, true);
         increase_pc(asmx86);
     }
 
     void srlw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(ecx, dword_ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->shr(eax, cl);
-        write_reg_x86(asmx86, instr.rd, rax);  // Already zero-extended
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Logical, true);
         increase_pc(asmx86);
     }
 
     void sraw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
-        using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
-        asmx86->mov(ecx, dword_ptr(regs_beg_x86_, instr.rs2 * 8));
-        asmx86->sar(eax, cl);
-        asmx86->movsxd(rax, eax);
-        write_reg_x86(asmx86, instr.rd, rax);
+        emit_var_shift_x86(asmx86, instr, ShiftOp::Arith, true);
         increase_pc(asmx86);
     }
 
     void slliw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg32_x86(asmx86, eax, instr.rs1);
         asmx86->shl(eax, (unsigned)instr.imm);
         asmx86->movsxd(rax, eax);
         write_reg_x86(asmx86, instr.rd, rax);
@@ -1761,15 +2677,16 @@ private:
 
     void srliw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg32_x86(asmx86, eax, instr.rs1);
         asmx86->shr(eax, (unsigned)instr.imm);
-        write_reg_x86(asmx86, instr.rd, rax);  // Zero-extended by default
+        asmx86->movsxd(rax, eax);  // *W results are sign-extended, even for a zero shift
+        write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
     }
 
     void sraiw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(eax, dword_ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg32_x86(asmx86, eax, instr.rs1);
         asmx86->sar(eax, (unsigned)instr.imm);
         asmx86->movsxd(rax, eax);
         write_reg_x86(asmx86, instr.rd, rax);
@@ -1778,16 +2695,17 @@ private:
 
     void ecall_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        increase_pc(asmx86);
+        store_next_pc_x86(asmx86);
+        flush_count_x86(asmx86);
         asmx86->mov(rdi, (uint64_t)hart_ptr);
         asmx86->mov(rax, (uint64_t)ecall_func_ptr);
         asmx86->call(rax);
-        asmx86->jmp(*exit_label_);
+        asmx86->jmp(exit_site_x86(asmx86, ExitReason::Ecall));
     }
 
     void csrw_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
         using namespace asmjit::x86;
-        asmx86->mov(rax, ptr(regs_beg_x86_, instr.rs1 * 8));
+        read_reg_x86(asmx86, rax, instr.rs1);
         asmx86->mov(rdi, (uint64_t)hart_ptr);
         asmx86->mov(rsi, (uint64_t)instr.imm);
         asmx86->mov(rdx, rax);
@@ -1796,5 +2714,21 @@ private:
         write_reg_x86(asmx86, instr.rd, rax);
         increase_pc(asmx86);
     }
+
+    void sfence_vma_x86(asmjit::x86::Assembler* asmx86, Hart* hart, DecodedInstruction& instr) {
+        using namespace asmjit::x86;
+        // Operand values are read here since pinned registers are not
+        // written back; which of them are x0 is known now
+        const uint64_t scope = (instr.rs1 != 0 ? sfence_vma_has_va : 0) |
+                               (instr.rs2 != 0 ? sfence_vma_has_asid : 0);
+        read_reg_x86(asmx86, rax, instr.rs1);
+        read_reg_x86(asmx86, rdx, instr.rs2);
+        asmx86->mov(rdi, (uint64_t)hart_ptr);
+        asmx86->mov(rsi, rax);
+        asmx86->mov(rcx, scope);
+        asmx86->mov(rax, (uint64_t)sfence_vma_func_ptr);
+        asmx86->call(rax);
+        increase_pc(asmx86);
+    }
 };
 }
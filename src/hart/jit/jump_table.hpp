@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "decode_execute_module/common.hpp"
+
+namespace jit {
+
+// A bounded jump table as GCC emits it for a switch statement:
+//
+//     li    t, K                  bound (optional form: bgeu idx, t with t = K + 1)
+//     bltu  t, idx, default
+//     slli  idx, idx, 2           possibly slli 32 + srli 30 to zero-extend
+//     lui   base, %hi(table)      or auipc + addi
+//     addi  base, base, %lo(table)
+//     add   idx, idx, base
+//     lw    idx, 0(idx)           lw/lwu/ld
+//     add   idx, idx, base        only for table-relative entries
+//     jr    idx
+struct JumpTable {
+    uint64_t first_pc = 0;              // first instruction of the matched sequence
+    std::vector<uint64_t> targets;      // one per index, 0..K
+};
+
+// Indirect jump pc -> every pc its table can send control to
+using JumpTargets = std::unordered_map<uint64_t, std::vector<uint64_t>>;
+
+namespace jump_table_detail {
+
+struct Sym {
+    enum class Kind { Unknown, Const, Index, Addr, Entry, Target };
+    Kind kind = Kind::Unknown;
+    uint64_t value = 0;     // Const value, Addr/Entry table base, Target added base
+    uint32_t shift = 0;     // Index/Addr/Entry: index scaled by 1 << shift
+    int size = 0;           // Entry/Target: entry size in bytes
+    bool sign = false;      // Entry/Target: entry is sign-extended
+    uint64_t entry_base = 0;
+
+    static Sym constant(uint64_t v) {
+        Sym s;
+        s.kind = Kind::Const;
+        s.value = v;
+        return s;
+    }
+};
+
+}
+
+// Matches the sequence ending in the indirect jump at jalr_pc. decode(pc)
+// returns the instruction at pc if it is code, read(addr, size) reads a table
+// entry from read-only data and is_code(pc) checks jump targets.
+template<typename Decode, typename Read, typename IsCode>
+std::optional<JumpTable> match_jump_table(uint64_t jalr_pc, Decode&& decode, Read&& read, IsCode&& is_code) {
+    using jump_table_detail::Sym;
+    using Kind = Sym::Kind;
+
+    constexpr size_t max_window = 16;
+    constexpr uint64_t max_entries = 1024;
+
+    // Straight-line code back to the bound check and one control transfer past it
+    std::vector<std::pair<uint64_t, DecodedInstruction>> seq;
+    std::optional<size_t> branch_pos;
+    for (uint64_t pc = jalr_pc; seq.size() < max_window; pc -= 4) {
+        std::optional<DecodedInstruction> instr = decode(pc);
+        if (!instr) {
+            break;
+        }
+        const bool transfer = instr->format == InstructionFormat::B ||
+                              instr->opcode == InstructionOpcode::JAL ||
+                              instr->opcode == InstructionOpcode::JALR ||
+                              instr->opcode == InstructionOpcode::ECALL;
+        if (pc != jalr_pc && transfer) {
+            if (branch_pos || instr->format != InstructionFormat::B) {
+                break;
+            }
+            branch_pos = seq.size();
+        }
+        seq.emplace_back(pc, *instr);
+    }
+    if (!branch_pos) {
+        return std::nullopt;
+    }
+    std::reverse(seq.begin(), seq.end());
+    const size_t branch_idx = seq.size() - 1 - *branch_pos;
+
+    std::array<Sym, 32> regs{};
+    auto get = [&](uint8_t r) { return r == 0 ? Sym::constant(0) : regs[r]; };
+    auto set = [&](uint8_t r, Sym v) {
+        if (r != 0) {
+            regs[r] = v;
+        }
+    };
+
+    uint64_t bound = 0;
+    for (size_t i = 0; i < seq.size(); ++i) {
+        const auto& [pc, in] = seq[i];
+        const Sym a = get(in.rs1);
+        const Sym b = get(in.rs2);
+        const int64_t imm = in.imm;
+
+        if (i == branch_idx) {
+            // The table code is the not-taken path: derive idx <= bound
+            uint8_t idx_reg;
+            if (in.opcode == InstructionOpcode::BLTU && a.kind == Kind::Const) {
+                bound = a.value;
+                idx_reg = in.rs2;
+            } else if (in.opcode == InstructionOpcode::BGEU && b.kind == Kind::Const && b.value != 0) {
+                bound = b.value - 1;
+                idx_reg = in.rs1;
+            } else {
+                return std::nullopt;
+            }
+            if (bound >= max_entries || idx_reg == 0) {
+                return std::nullopt;
+            }
+            regs.fill(Sym{});
+            Sym idx;
+            idx.kind = Kind::Index;
+            set(idx_reg, idx);
+            continue;
+        }
+
+        Sym r;
+        switch (in.opcode) {
+            case InstructionOpcode::LUI:
+                r = Sym::constant(static_cast<uint64_t>(imm << 12));
+                break;
+            case InstructionOpcode::AUIPC:
+                r = Sym::constant(pc + static_cast<uint64_t>(imm << 12));
+                break;
+            case InstructionOpcode::ADDI:
+                if (a.kind == Kind::Const) {
+                    r = Sym::constant(a.value + imm);
+                } else if (a.kind == Kind::Addr) {
+                    r = a;
+                    r.value += imm;
+                }
+                break;
+            case InstructionOpcode::SLLI:
+                if (a.kind == Kind::Index && a.shift + imm <= 32) {
+                    r = a;
+                    r.shift += static_cast<uint32_t>(imm);
+                }
+                break;
+            case InstructionOpcode::SRLI:
+                if (a.kind == Kind::Index && a.shift >= imm) {
+                    r = a;
+                    r.shift -= static_cast<uint32_t>(imm);
+                }
+                break;
+            case InstructionOpcode::ADD: {
+                const Sym* var = (a.kind == Kind::Const) ? &b : &a;
+                const Sym* cst = (a.kind == Kind::Const) ? &a : &b;
+                if (cst->kind != Kind::Const) {
+                    break;
+                }
+                if (var->kind == Kind::Const) {
+                    r = Sym::constant(var->value + cst->value);
+                } else if (var->kind == Kind::Index) {
+                    r = *var;
+                    r.kind = Kind::Addr;
+                    r.value = cst->value;
+                } else if (var->kind == Kind::Entry) {
+                    r = *var;
+                    r.kind = Kind::Target;
+                    r.value = cst->value;
+                }
+                break;
+            }
+            case InstructionOpcode::LW:
+            case InstructionOpcode::LWU:
+            case InstructionOpcode::LD:
+                if (a.kind == Kind::Addr) {
+                    r = a;
+                    r.kind = Kind::Entry;
+                    r.entry_base = a.value + imm;
+                    r.value = 0;
+                    r.size = (in.opcode == InstructionOpcode::LD) ? 8 : 4;
+                    r.sign = (in.opcode == InstructionOpcode::LW);
+                }
+                break;
+            case InstructionOpcode::JALR: {
+                if (i + 1 != seq.size() || (a.kind != Kind::Entry && a.kind != Kind::Target)) {
+                    return std::nullopt;
+                }
+                JumpTable table;
+                table.first_pc = seq.front().first;
+                for (uint64_t k = 0; k <= bound; ++k) {
+                    std::optional<uint64_t> raw = read(a.entry_base + (k << a.shift), a.size);
+                    if (!raw) {
+                        return std::nullopt;
+                    }
+                    uint64_t entry = *raw;
+                    if (a.sign && a.size == 4) {
+                        entry = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(entry)));
+                    }
+                    const uint64_t target = (entry + a.value + imm) & ~uint64_t{1};
+                    if (!is_code(target)) {
+                        return std::nullopt;
+                    }
+                    table.targets.push_back(target);
+                }
+                return table;
+            }
+            default:
+                break;
+        }
+        if (in.format == InstructionFormat::R || in.format == InstructionFormat::I ||
+            in.format == InstructionFormat::U || in.format == InstructionFormat::J) {
+            set(in.rd, r);
+        }
+    }
+    return std::nullopt;
+}
+
+}
@@ -17,6 +17,18 @@ uint64_t csrw_trampoline(Hart* hart, uint64_t csr, uint64_t value) {
     return old_val;
 }
 
+void sfence_vma_trampoline(Hart* hart, uint64_t va, uint64_t asid, uint64_t scope) {
+    std::optional<va_t> fence_va;
+    std::optional<uint16_t> fence_asid;
+    if (scope & sfence_vma_has_va) {
+        fence_va = va;
+    }
+    if (scope & sfence_vma_has_asid) {
+        fence_asid = static_cast<uint16_t>(asid);
+    }
+    hart->sfence_vma(fence_va, fence_asid);
+}
+
 void ecall_trampoline(Hart* hart) {
     hart->do_ecall();
 }
@@ -25,6 +37,9 @@ void call_trampoline(Hart* hart, uint64_t target_pc, uint64_t return_pc) {
     if (!hart) {
         return;
     }
+    if (hart->try_native_call(target_pc)) {
+        return;
+    }
     if (hart->ensure_jit_function(target_pc)) {
         hart->execute_jitted_function(target_pc);
         return;
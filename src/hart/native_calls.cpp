@@ -0,0 +1,151 @@
+#include "hart.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Host versions of the routines -march=rv64i code spends most of its time in.
+// Arguments come in a0..a2 and the result goes to a0 as the RISC-V psABI has
+// it. The string and memory routines work on guest memory in place, so they
+// only apply while addresses are physical and the whole range is RAM;
+// otherwise, for divisions by zero and while modules hook instructions or
+// memory, the guest's own code runs.
+
+std::optional<Hart::NativeCall> Hart::native_call_by_name(std::string_view name) {
+    static const std::unordered_map<std::string_view, NativeCall> by_name = {
+        {"memcpy", NativeCall::Memcpy},
+        {"memmove", NativeCall::Memmove},
+        {"memset", NativeCall::Memset},
+        {"strlen", NativeCall::Strlen},
+        {"strcmp", NativeCall::Strcmp},
+        {"__muldi3", NativeCall::Muldi3},
+        {"__divdi3", NativeCall::Divdi3},
+        {"__udivdi3", NativeCall::Udivdi3},
+        {"__moddi3", NativeCall::Moddi3},
+        {"__umoddi3", NativeCall::Umoddi3},
+    };
+    auto it = by_name.find(name);
+    if (it == by_name.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void Hart::set_native_calls(std::unordered_map<uint64_t, NativeCall> calls) {
+    if (!native_libcalls_) {
+        return;
+    }
+    native_calls_ = std::move(calls);
+}
+
+bool Hart::is_native_call(uint64_t pc) const {
+    return !native_calls_.empty() && native_calls_.count(pc) != 0;
+}
+
+uint8_t* Hart::guest_span(uint64_t addr, uint64_t size) {
+    const uint64_t mem_size = get_memory_size();
+    if (!is_paging_disabled() || addr > mem_size || size > mem_size - addr ||
+        mmu_.is_device_range(addr, size != 0 ? size : mem_size - addr)) {
+        return nullptr;
+    }
+    return get_memory_ptr() + addr;
+}
+
+bool Hart::try_native_call(uint64_t pc) {
+    auto it = native_calls_.find(pc);
+    if (it == native_calls_.end() || has_module_callbacks()) {
+        return false;
+    }
+
+    const reg_t a0 = get_reg(10);
+    const reg_t a1 = get_reg(11);
+    const reg_t a2 = get_reg(12);
+    const auto s0 = static_cast<int64_t>(a0);
+    const auto s1 = static_cast<int64_t>(a1);
+    reg_t result = 0;
+
+    switch (it->second) {
+        case NativeCall::Memcpy:
+        case NativeCall::Memmove: {
+            // memmove covers both: overlapping memcpy is undefined anyway
+            uint8_t* dst = guest_span(a0, a2);
+            uint8_t* src = guest_span(a1, a2);
+            if (dst == nullptr || src == nullptr) {
+                return false;
+            }
+            std::memmove(dst, src, a2);
+            result = a0;
+            break;
+        }
+        case NativeCall::Memset: {
+            uint8_t* dst = guest_span(a0, a2);
+            if (dst == nullptr) {
+                return false;
+            }
+            std::memset(dst, static_cast<int>(a1 & 0xff), a2);
+            result = a0;
+            break;
+        }
+        case NativeCall::Strlen: {
+            const uint8_t* s = guest_span(a0, 0);
+            if (s == nullptr) {
+                return false;
+            }
+            const void* nul = std::memchr(s, 0, get_memory_size() - a0);
+            if (nul == nullptr) {
+                return false;
+            }
+            result = static_cast<const uint8_t*>(nul) - s;
+            break;
+        }
+        case NativeCall::Strcmp: {
+            const uint8_t* l = guest_span(a0, 0);
+            const uint8_t* r = guest_span(a1, 0);
+            if (l == nullptr || r == nullptr) {
+                return false;
+            }
+            const uint64_t limit = get_memory_size() - std::max(a0, a1);
+            uint64_t i = 0;
+            while (i < limit && l[i] == r[i] && l[i] != 0) {
+                ++i;
+            }
+            if (i == limit) {
+                return false;
+            }
+            result = static_cast<reg_t>(static_cast<int64_t>(l[i]) - static_cast<int64_t>(r[i]));
+            break;
+        }
+        case NativeCall::Muldi3:
+            result = a0 * a1;
+            break;
+        case NativeCall::Divdi3:
+            if (a1 == 0) {
+                return false;
+            }
+            // INT64_MIN / -1 wraps, as libgcc's unsigned long division does
+            result = (s1 == -1) ? -a0 : static_cast<reg_t>(s0 / s1);
+            break;
+        case NativeCall::Udivdi3:
+            if (a1 == 0) {
+                return false;
+            }
+            result = a0 / a1;
+            break;
+        case NativeCall::Moddi3:
+            if (a1 == 0) {
+                return false;
+            }
+            result = (s1 == -1) ? 0 : static_cast<reg_t>(s0 % s1);
+            break;
+        case NativeCall::Umoddi3:
+            if (a1 == 0) {
+                return false;
+            }
+            result = a0 % a1;
+            break;
+    }
+
+    set_reg(10, result);
+    pc_ = get_reg(1) & ~reg_t{1};
+    instr_counter_ += 1;
+    return true;
+}
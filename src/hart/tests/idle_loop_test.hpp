@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "../idle_loop.hpp"
+
+//-----------------------------------------------------------------------------------------
+
+// addi x5, x5, step; <op> x5, x6, head (or x6, x5 with the bound on the left)
+static riscv_sim::IdleLoop counter_loop(InstructionOpcode op, int32_t step, bool counter_lhs = true) {
+    DecodedInstruction addi;
+    addi.opcode = InstructionOpcode::ADDI;
+    addi.format = InstructionFormat::I;
+    addi.rd = 5;
+    addi.rs1 = 5;
+    addi.imm = step;
+
+    DecodedInstruction br;
+    br.opcode = op;
+    br.format = InstructionFormat::B;
+    br.rs1 = counter_lhs ? 5 : 6;
+    br.rs2 = counter_lhs ? 6 : 5;
+    br.imm = -4;
+
+    riscv_sim::IdleLoop loop;
+    loop.kind = riscv_sim::IdleLoop::Kind::Counter;
+    loop.head = 0x1000;
+    loop.body = {addi, br};
+    loop.counter = 5;
+    loop.step = step;
+    return loop;
+}
+
+class idle_loop : public ::testing::Test {
+    protected:
+        void SetUp() {}
+};
+
+//-----------------------------------------------------------------------------------------
+
+TEST_F(idle_loop, bne_step_plus_one) {
+    auto loop = counter_loop(InstructionOpcode::BNE, 1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 0, 7), std::optional<uint64_t>{7});
+}
+
+TEST_F(idle_loop, bne_step_minus_one) {
+    auto loop = counter_loop(InstructionOpcode::BNE, -1, false);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 10, 0), std::optional<uint64_t>{10});
+}
+
+TEST_F(idle_loop, bne_half_range_step_minus_one) {
+    // bound - value is INT64_MIN: 2^63 decrements, no INT64_MIN / -1
+    auto loop = counter_loop(InstructionOpcode::BNE, -1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 0, 0x8000000000000000ULL),
+              std::optional<uint64_t>{0x8000000000000000ULL});
+}
+
+TEST_F(idle_loop, bne_sign_mismatch) {
+    // Counting up towards a lower bound only gets there by wrapping
+    auto loop = counter_loop(InstructionOpcode::BNE, 1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 10, 5), std::nullopt);
+}
+
+TEST_F(idle_loop, bne_step_misses_bound) {
+    auto loop = counter_loop(InstructionOpcode::BNE, 2);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 0, 7), std::nullopt);
+}
+
+TEST_F(idle_loop, blt_counts_up) {
+    auto loop = counter_loop(InstructionOpcode::BLT, 1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 0, 100), std::optional<uint64_t>{100});
+}
+
+TEST_F(idle_loop, bge_counts_down_past_bound) {
+    auto loop = counter_loop(InstructionOpcode::BGE, -1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 10, 0), std::optional<uint64_t>{11});
+}
+
+TEST_F(idle_loop, bgeu_wraps) {
+    // counter >= 0 holds for every unsigned value: the counter wraps first
+    auto loop = counter_loop(InstructionOpcode::BGEU, 1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, 5, 0), std::nullopt);
+}
+
+TEST_F(idle_loop, bltu_at_top_of_range) {
+    // No room to step before the unsigned range ends
+    auto loop = counter_loop(InstructionOpcode::BLTU, 1);
+    ASSERT_EQ(riscv_sim::counter_loop_trip_count(loop, UINT64_MAX, UINT64_MAX), std::nullopt);
+}
@@ -0,0 +1,11 @@
+#include <gtest/gtest.h>
+
+#include "idle_loop_test.hpp"
+
+//-----------------------------------------------------------------------------------------
+
+int main (int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret_val = RUN_ALL_TESTS();
+    return ret_val;
+}
@@ -43,7 +43,7 @@ public:
         if (bb != nullptr) {
             bb->search_rate++;
 
-            if(use_jit && (bb->search_rate == jit_bound)) {
+            if(use_jit && !bb->get_is_jitted() && (bb->search_rate == jit_bound)) {
                 auto it = std::find_if(bb->instrs.begin(), bb->instrs.end(), [](DecodedInstruction& inst) {
                     return (inst.format == InstructionFormat::J || inst.format == InstructionFormat::B);
                 });
@@ -64,6 +64,7 @@ public:
         if (!compiled_bb) {
             return false;
         }
+        exit_tables.push_back(compiled_bb->exit_table);
         blk.set_jitted_bb(std::move(compiled_bb));
         bb_cache.install(blk.start_pc, std::move(blk));
         return true;
@@ -77,14 +78,21 @@ public:
         return use_jit;
     }
 
+    // Why compiled code returned to the dispatcher, over every block compiled
+    void write_exit_report(std::ostream& out) const {
+        jit::write_exit_report(out, exit_tables);
+    }
+
 private:
     void compile_bb(const Block* blk) {
         auto compiled_bb = jitter.compile_block(*blk, hart);
+        exit_tables.push_back(compiled_bb->exit_table);
         // std::cerr << "JIT: compiled BB at PC: 0x" << std::hex << blk->start_pc << std::dec << std::endl;
         const_cast<Block*>(blk)->set_jitted_bb(std::move(compiled_bb));// UGLY!!!
     }
 
     jit::JITImpl jitter;
+    std::vector<std::shared_ptr<jit::ExitTable>> exit_tables;
     naive_cache   bb_cache;
     // utils::lru_cache<uint64_t, Block> bb_cache; //lto works with lru
     THart*       hart;
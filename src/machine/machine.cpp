@@ -4,9 +4,13 @@
 #include <iostream>
 #include <iomanip>
 #include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include <stdexcept>
 #include <cstring>
 #include <chrono>
+#include <unordered_map>
 #include <vector>
 #include "modules/example_module.hpp"
 
@@ -26,6 +30,55 @@ static void ehdr_sanity_check(const Elf64_Ehdr &ehdr) {
     }
 }
 
+// Function symbols of the static symbol table the hart has native versions of
+static std::unordered_map<uint64_t, Hart::NativeCall> find_native_calls(std::ifstream& file,
+                                                                        const Elf64_Ehdr& ehdr) {
+    std::unordered_map<uint64_t, Hart::NativeCall> calls;
+    file.clear();
+    if (ehdr.e_shoff == 0 || ehdr.e_shentsize < sizeof(Elf64_Shdr)) {
+        return calls;
+    }
+
+    std::vector<Elf64_Shdr> shdrs(ehdr.e_shnum);
+    for (int i = 0; i < ehdr.e_shnum; ++i) {
+        file.seekg(ehdr.e_shoff + static_cast<uint64_t>(i) * ehdr.e_shentsize);
+        file.read(reinterpret_cast<char*>(&shdrs[i]), sizeof(Elf64_Shdr));
+    }
+    if (!file) {
+        file.clear();
+        return calls;
+    }
+
+    for (const auto& symtab : shdrs) {
+        if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= shdrs.size()) {
+            continue;
+        }
+        const Elf64_Shdr& strtab = shdrs[symtab.sh_link];
+        std::vector<char> names(strtab.sh_size + 1, '\0');
+        file.seekg(strtab.sh_offset);
+        file.read(names.data(), strtab.sh_size);
+
+        std::vector<Elf64_Sym> syms(symtab.sh_size / sizeof(Elf64_Sym));
+        file.seekg(symtab.sh_offset);
+        file.read(reinterpret_cast<char*>(syms.data()), syms.size() * sizeof(Elf64_Sym));
+        if (!file) {
+            file.clear();
+            continue;
+        }
+
+        for (const auto& sym : syms) {
+            if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_shndx == SHN_UNDEF ||
+                sym.st_name >= strtab.sh_size) {
+                continue;
+            }
+            if (auto call = Hart::native_call_by_name(names.data() + sym.st_name)) {
+                calls.emplace(sym.st_value, *call);
+            }
+        }
+    }
+    return calls;
+}
+
 void Machine::load_elf(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
     if (!file) 
@@ -37,16 +90,21 @@ void Machine::load_elf(const std::string& filename) {
     
     hart_.set_pc(ehdr.e_entry);
 
-    file.seekg(ehdr.e_phoff);
+    // Segments are mapped or pread straight into guest memory
+    const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open ELF file");
+    struct FdCloser { int fd; ~FdCloser() { ::close(fd); } } fd_closer{fd};
+
     std::vector<Hart::CodeRange> exec_ranges;
+    std::vector<Hart::CodeRange> rodata_ranges;
     for (int i = 0; i < ehdr.e_phnum; ++i) {
+        // Segment loading moves the read position: seek to each header
         Elf64_Phdr phdr;
+        file.seekg(ehdr.e_phoff + static_cast<uint64_t>(i) * ehdr.e_phentsize);
         file.read(reinterpret_cast<char*>(&phdr), sizeof(phdr));
         if (phdr.p_type == PT_LOAD) {
-            file.seekg(phdr.p_offset);
-            std::vector<uint8_t> data(phdr.p_filesz);
-            file.read(reinterpret_cast<char*>(data.data()), phdr.p_filesz);
-            memory_.load_data(phdr.p_vaddr, data.data(), phdr.p_filesz);
+            memory_.load_file(phdr.p_vaddr, fd, phdr.p_offset, phdr.p_filesz);
 
             // for .bss
             if (phdr.p_memsz > phdr.p_filesz) {
@@ -58,6 +116,12 @@ void Machine::load_elf(const std::string& filename) {
                     phdr.p_vaddr + phdr.p_memsz
                 });
             }
+            if (!(phdr.p_flags & PF_W)) {
+                rodata_ranges.push_back(Hart::CodeRange{
+                    phdr.p_vaddr,
+                    phdr.p_vaddr + phdr.p_filesz
+                });
+            }
         }
     }
 
@@ -65,13 +129,29 @@ void Machine::load_elf(const std::string& filename) {
     hart_.set_reg(2, StackBottom);
     hart_.set_halt(false);
     hart_.set_exec_ranges(std::move(exec_ranges));
+    hart_.set_rodata_ranges(std::move(rodata_ranges));
+    hart_.set_native_calls(find_native_calls(file, ehdr));
+    elf_loaded_ = true;
     hart_.predecode_and_jit_if_small();
 }
 
+void Machine::add_device(pa_t base, size_t size, std::shared_ptr<MMIODevice> device) {
+    if (elf_loaded_) {
+        throw std::logic_error("MMIO devices must be added before load_elf");
+    }
+    mmu_.add_device(base, size, std::move(device));
+    // Drops translations and the hart's cached code page
+    hart_.sfence_vma(std::nullopt, std::nullopt);
+}
+
 void Machine::run(uint64_t max_cycles) {
     volatile uint64_t cycle = 0;
     auto start = std::chrono::high_resolution_clock::now();
 
+    // Compiled loops check the budget on back-edges, so max_cycles also holds
+    // while control stays inside a JIT function block
+    hart_.set_instr_budget(max_cycles);
+
     while ((max_cycles == 0 || cycle < max_cycles) && !hart_.is_halt()) {
         cycle += hart_.step();
     }
@@ -90,6 +170,59 @@ void Machine::run(uint64_t max_cycles) {
     
 }
 
+TLBConfig Machine::tlb_config(size_t entries, size_t ways, const std::string& replacement) {
+    TLBConfig config{entries, ways, TLBReplacement::LRU};
+    if (replacement == "round_robin") {
+        config.replacement = TLBReplacement::RoundRobin;
+    } else if (replacement != "lru") {
+        throw std::runtime_error("Unknown tlb_replacement: " + replacement);
+    }
+    return config;
+}
+
+MemoryBacking Machine::memory_backing(const std::string& hugepages) {
+    if (hugepages == "off") {
+        return MemoryBacking::Normal;
+    }
+    if (hugepages == "madvise") {
+        return MemoryBacking::Madvise;
+    }
+    if (hugepages == "hugetlb") {
+        return MemoryBacking::HugeTLB;
+    }
+    throw std::runtime_error("Unknown memory_hugepages: " + hugepages);
+}
+
+void Machine::dump_stats(const std::string& filename) const {
+    std::ofstream out(filename);
+    if (!out) {
+        throw std::runtime_error("Failed to open statistics file: " + filename);
+    }
+
+    static const char* const backing_names[] = {"off", "madvise", "hugetlb"};
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    out << "# Memory\n";
+    out << "guest_size " << memory_.size() << '\n';
+    out << "guest_backing " << backing_names[static_cast<int>(memory_.backing())] << '\n';
+    out << "guest_resident " << memory_.resident() << '\n';
+    out << "host_peak_rss " << static_cast<uint64_t>(usage.ru_maxrss) * 1024 << '\n';
+
+    auto tlb_line = [&](const char* name, const TLBStats& stats) {
+        out << name << " hits " << stats.hits << " misses " << stats.misses << '\n';
+    };
+    out << "# TLB\n";
+    tlb_line("itlb_micro", mmu_.itlb_micro().stats());
+    tlb_line("dtlb_r_micro", mmu_.dtlb_r_micro().stats());
+    tlb_line("dtlb_w_micro", mmu_.dtlb_w_micro().stats());
+    tlb_line("itlb", mmu_.itlb().stats());
+    tlb_line("dtlb_r", mmu_.dtlb_r().stats());
+    tlb_line("dtlb_w", mmu_.dtlb_w().stats());
+    tlb_line("page_walk_cache", mmu_.pwc().stats());
+
+    hart_.write_jit_exit_report(out);
+}
+
 void Machine::dump_regs() const {
     for (int i = 0; i < 32; ++i) {
         std::cout << "x" << i << ": 0x" << std::hex << std::setw(16) << std::setfill('0') << hart_.get_reg(i) << std::endl;
@@ -12,10 +12,14 @@
 constexpr size_t StackSize = 0x1000;
 constexpr va_t StackBottom = 0x1000000ULL;
 constexpr va_t StackTop = StackBottom - StackSize;
+static_assert(StackBottom <= sim_config_t::min_memory_size, "guest RAM must hold the stack");
 
 class Machine {
 public:
-    Machine(sim_config_t& sim_conf) : memory_(), mmu_(memory_), hart_(mmu_, sim_conf) {
+    Machine(sim_config_t& sim_conf) : memory_(sim_conf.memory_size, memory_backing(sim_conf.memory_hugepages)),
+        mmu_(memory_, tlb_config(sim_conf.itlb_entries, sim_conf.itlb_ways, sim_conf.tlb_replacement),
+                      tlb_config(sim_conf.dtlb_entries, sim_conf.dtlb_ways, sim_conf.tlb_replacement)),
+        hart_(mmu_, sim_conf) {
         memory_.zero_init(StackTop, StackSize);
     }
     Machine() : memory_(), mmu_(memory_), hart_(mmu_) {
@@ -25,14 +29,26 @@ public:
     Hart& get_hart() { return hart_; }
     const Memory& get_memory() const { return memory_; }
 
+    // Maps an MMIO device at physical [base, base + size), whole pages.
+    // Compiled code has the device map built in, so devices have to be
+    // added before load_elf.
+    void add_device(pa_t base, size_t size, std::shared_ptr<MMIODevice> device);
+
     void load_elf(const std::string& filename);
 
     void run(uint64_t max_cycles = 0);
 
     void dump_regs() const;
+    // Statistics for --output: guest RAM residency, TLB hit rates and the
+    // JIT exit report
+    void dump_stats(const std::string& filename) const;
 
 private:
+    static TLBConfig tlb_config(size_t entries, size_t ways, const std::string& replacement);
+    static MemoryBacking memory_backing(const std::string& hugepages);
+
     Memory memory_;
     MMU mmu_;
     Hart hart_;
+    bool elf_loaded_ = false;
 };
@@ -11,10 +11,10 @@
 int main(int argc, char* argv[]) {
     
     prog_config_t prog_conf{argc, argv};
-    sim_config_t  sim_conf{prog_conf.config_file};
-    Machine machine{sim_conf};
 
     try {
+        sim_config_t  sim_conf{prog_conf.config_file};
+        Machine machine{sim_conf};
         machine.load_elf(prog_conf.input_file);
 #ifdef ENABLE_MODULES
         if (sim_conf.use_jit && prog_conf.module_name.has_value()) {
@@ -28,6 +28,9 @@ int main(int argc, char* argv[]) {
         }
 #endif
         machine.run(sim_conf.max_cycles);
+        if (!prog_conf.stat_file.empty()) {
+            machine.dump_stats(prog_conf.stat_file);
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <hart/hart_common.hpp>
+
+// A device behind a range of physical addresses. Offsets are relative to
+// the start of the range; size is 1, 2, 4 or 8.
+class MMIODevice {
+public:
+    virtual ~MMIODevice() = default;
+
+    virtual uint64_t read(uint64_t offset, int size) = 0;
+    virtual void write(uint64_t offset, uint64_t value, int size) = 0;
+};
+
+// Physical address map: device regions in a sorted interval table, RAM
+// everywhere else. Regions are page aligned, so one lookup per page tells
+// whether the page is RAM, and with no devices every address is.
+class Bus {
+public:
+    struct Region {
+        pa_t base;
+        pa_t end;
+        std::shared_ptr<MMIODevice> device;
+    };
+
+    void add_device(pa_t base, size_t size, std::shared_ptr<MMIODevice> device) {
+        constexpr pa_t page_mask = 4096 - 1;
+        if (size == 0 || (base & page_mask) != 0 || (size & page_mask) != 0) {
+            throw std::invalid_argument("MMIO region must be whole pages");
+        }
+        if (overlaps(base, size)) {
+            throw std::invalid_argument("MMIO region overlaps another device");
+        }
+        Region region{base, base + size, std::move(device)};
+        auto it = std::upper_bound(regions_.begin(), regions_.end(), base,
+                                   [](pa_t pa, const Region& r) { return pa < r.base; });
+        regions_.insert(it, std::move(region));
+        lo_ = regions_.front().base;
+        hi_ = regions_.back().end;
+    }
+
+    // Device region containing pa, nullptr for RAM
+    const Region* find(pa_t pa) const {
+        if (pa - lo_ >= hi_ - lo_) {
+            return nullptr;     // outside every device, or no devices at all
+        }
+        auto it = std::upper_bound(regions_.begin(), regions_.end(), pa,
+                                   [](pa_t a, const Region& r) { return a < r.base; });
+        if (it == regions_.begin()) {
+            return nullptr;
+        }
+        --it;
+        return pa < it->end ? &*it : nullptr;
+    }
+
+    // Whether any device lies in [base, base + size)
+    bool overlaps(pa_t base, size_t size) const {
+        if (regions_.empty() || base >= hi_ || base + size <= lo_) {
+            return false;
+        }
+        return std::any_of(regions_.begin(), regions_.end(), [&](const Region& r) {
+            return r.base < base + size && base < r.end;
+        });
+    }
+
+    bool empty() const { return regions_.empty(); }
+    // Smallest range holding every device, [lo, hi); empty with none
+    pa_t hull_lo() const { return lo_; }
+    pa_t hull_hi() const { return hi_; }
+
+private:
+    std::vector<Region> regions_;
+    pa_t lo_ = 0;   // hull of all regions
+    pa_t hi_ = 0;
+};
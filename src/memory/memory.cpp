@@ -6,10 +6,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <iostream>
+#include <vector>
 
 /// TODO: exceptions should be processed properly, now they are not caught
 
-Memory::Memory(size_t size) : backing_(nullptr), capacity_(0) {
+Memory::Memory(size_t size, MemoryBacking backing) : backing_(nullptr), capacity_(0), backing_kind_(backing) {
     if (size == 0) {
         throw std::invalid_argument("Memory size must be > 0");
     }
@@ -18,17 +19,39 @@ Memory::Memory(size_t size) : backing_(nullptr), capacity_(0) {
     if (page_size <= 0) 
         throw std::runtime_error("failed to get page size");
 
-    size_t pages = (size + page_size - 1) / page_size;
-    size_t alloc_size = pages * static_cast<size_t>(page_size);
-
-    void* ptr = mmap(nullptr, alloc_size,
-                     PROT_READ | PROT_WRITE,
-                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
-                     -1, 0);
+    // Hugepage backings need whole 2 MiB pages
+    constexpr size_t huge_page_size = 2ULL * 1024ULL * 1024ULL;
+    const size_t granule = (backing == MemoryBacking::Normal) ? static_cast<size_t>(page_size) : huge_page_size;
+    size_t alloc_size = (size + granule - 1) / granule * granule;
+
+    void* ptr = MAP_FAILED;
+    if (backing == MemoryBacking::HugeTLB) {
+        // No MAP_NORESERVE: the pool has to hold the whole size up front,
+        // or touching a page past what it has would raise SIGBUS
+        ptr = mmap(nullptr, alloc_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1, 0);
+        if (ptr == MAP_FAILED) {
+            std::cerr << "MAP_HUGETLB failed (" << strerror(errno)
+                      << "), using transparent hugepages" << std::endl;
+            backing_kind_ = MemoryBacking::Madvise;
+        }
+    }
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(nullptr, alloc_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1, 0);
+    }
 
     if (ptr == MAP_FAILED) {
         throw std::runtime_error(std::string("mmap failed: ") + strerror(errno));
     }
+    if (backing_kind_ == MemoryBacking::Madvise) {
+        // Only a hint: the kernel may have THP disabled
+        madvise(ptr, alloc_size, MADV_HUGEPAGE);
+    }
 
     backing_ = static_cast<uint8_t*>(ptr);
     capacity_ = alloc_size;
@@ -75,17 +98,94 @@ void Memory::load_data(uint64_t addr, const uint8_t* data, size_t size) {
     std::memcpy(backing_ + static_cast<size_t>(addr), data, size);
 }
 
+namespace {
+
+void read_fully(int fd, uint8_t* dst, size_t size, uint64_t offset) {
+    while (size > 0) {
+        const ssize_t n = pread(fd, dst, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error(n == 0 ? std::string("unexpected end of file")
+                                            : std::string("pread failed: ") + strerror(errno));
+        }
+        dst += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+}
+
+}
+
+void Memory::load_file(uint64_t addr, int fd, uint64_t offset, size_t size) {
+    uint64_t end = addr + static_cast<uint64_t>(size);
+    if (end > capacity_)
+        throw std::out_of_range("memory load_file out of range");
+
+    // A file page can only be mapped where file offset and address agree
+    // modulo the page size, and never into hugetlb memory
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t map_begin = (addr + page_size - 1) & ~(page_size - 1);
+    uint64_t map_end = end & ~(page_size - 1);
+    if (backing_kind_ == MemoryBacking::HugeTLB || (addr - offset) % page_size != 0 || map_end <= map_begin) {
+        map_begin = map_end = end;
+    }
+    if (map_end > map_begin) {
+        void* ptr = mmap(backing_ + map_begin, map_end - map_begin,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED,
+                         fd, static_cast<off_t>(offset + (map_begin - addr)));
+        if (ptr == MAP_FAILED) {
+            map_begin = map_end = end;
+        }
+    }
+
+    read_fully(fd, backing_ + addr, map_begin - addr, offset);
+    read_fully(fd, backing_ + map_end, end - map_end, offset + (map_end - addr));
+}
+
 void Memory::zero_init(uint64_t addr, size_t size) {
     uint64_t end = addr + static_cast<uint64_t>(size);
     if (end > capacity_)
         throw std::out_of_range("memory zero_init out of range");
-    std::memset(backing_ + static_cast<size_t>(addr), 0, size);
+
+    const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t pages_begin = (addr + page_size - 1) & ~(page_size - 1);
+    uint64_t pages_end = end & ~(page_size - 1);
+    // Fresh anonymous pages also replace pages mapped from a file, which
+    // MADV_DONTNEED would only revert to the file's contents
+    if (backing_kind_ == MemoryBacking::HugeTLB || pages_end <= pages_begin ||
+        mmap(backing_ + pages_begin, pages_end - pages_begin,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+             -1, 0) == MAP_FAILED) {
+        pages_begin = pages_end = end;
+    } else if (backing_kind_ == MemoryBacking::Madvise) {
+        madvise(backing_ + pages_begin, pages_end - pages_begin, MADV_HUGEPAGE);
+    }
+    std::memset(backing_ + static_cast<size_t>(addr), 0, pages_begin - addr);
+    std::memset(backing_ + static_cast<size_t>(pages_end), 0, end - pages_end);
 }
 
 size_t Memory::size() const {
     return capacity_;
 }
 
+size_t Memory::resident() const {
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pages = (capacity_ + page_size - 1) / page_size;
+    std::vector<unsigned char> in_core(pages);
+    if (mincore(backing_, capacity_, in_core.data()) != 0) {
+        return 0;
+    }
+    size_t resident_pages = 0;
+    for (unsigned char page : in_core) {
+        resident_pages += page & 1;
+    }
+    return resident_pages * page_size;
+}
+
 uint8_t* Memory::data() {
     return backing_;
 }
@@ -2,20 +2,59 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+
+// Unsigned integer of N bytes, the unit of a fixed-size access
+template<int N> struct mem_word;
+template<> struct mem_word<1> { using type = uint8_t; };
+template<> struct mem_word<2> { using type = uint16_t; };
+template<> struct mem_word<4> { using type = uint32_t; };
+template<> struct mem_word<8> { using type = uint64_t; };
+template<int N> using mem_word_t = typename mem_word<N>::type;
+
+// How the host backs guest RAM
+enum class MemoryBacking {
+    Normal,         // 4 KiB pages
+    Madvise,        // transparent hugepages, MADV_HUGEPAGE
+    HugeTLB         // MAP_HUGETLB, falls back to Madvise when none are reserved
+};
 
 class Memory {
 public:
-    explicit Memory(size_t size = 16ULL * 1024ULL * 1024ULL * 1024ULL);
+    static constexpr size_t default_size = 16ULL * 1024ULL * 1024ULL * 1024ULL;
+
+    explicit Memory(size_t size = default_size,
+                    MemoryBacking backing = MemoryBacking::Normal);
     ~Memory();
 
     uint64_t read(uint64_t addr, int size_bytes) const;
     void write(uint64_t addr, uint64_t value, int size_bytes);
 
+    template<int N>
+    mem_word_t<N> read(uint64_t addr) const {
+        mem_word_t<N> value;
+        std::memcpy(&value, backing_ + addr, N);
+        return value;
+    }
+
+    template<int N>
+    void write(uint64_t addr, mem_word_t<N> value) {
+        std::memcpy(backing_ + addr, &value, N);
+    }
+
     // TODO(@ArsenySamoylov) remove this function or rewrite it - taking raw pointer as buffer is unsafe.
     void load_data(uint64_t start_addr, const uint8_t* data, size_t size);
+    // Puts size bytes of fd from offset at start_addr. Whole host pages are
+    // mapped copy-on-write straight from the file; the rest is read.
+    void load_file(uint64_t start_addr, int fd, uint64_t offset, size_t size);
+    // Whole pages are replaced by fresh anonymous ones, which the kernel
+    // zero-fills on first touch
     void zero_init(uint64_t start_addr, size_t size);
 
     size_t size() const;
+    MemoryBacking backing() const { return backing_kind_; }
+    // Bytes of guest RAM the host has actually given pages to
+    size_t resident() const;
 
     uint8_t* data();
     const uint8_t* data() const;
@@ -23,4 +62,5 @@ public:
 private:
     uint8_t* backing_ = nullptr;
     size_t capacity_ = 0;
+    MemoryBacking backing_kind_ = MemoryBacking::Normal;
 };
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "tlb.hpp"
+
+// Tiny fully-associative TLB for the hottest 4 KiB pages, looked up before
+// the set-associative one. Tags are kept apart from the payload so all of
+// them are compared at once. It holds one address space at a time and
+// empties itself when asked about another.
+class MicroTLB {
+public:
+    static constexpr size_t size = 8;
+
+    MicroTLB() { flush(); }
+
+    // Slot holding va's page, or -1
+    int lookup(va_t va, uint16_t asid) {
+        const int slot = probe(va, asid);
+        if (slot < 0)
+            count_miss();
+        return slot;
+    }
+
+    // lookup that leaves the miss to be counted by the caller
+    int probe(va_t va, uint16_t asid) {
+        if (asid != asid_) {
+            flush();
+            asid_ = asid;
+            return -1;
+        }
+        const uint64_t key = va >> 12;
+#if defined(__AVX2__)
+        const __m256i k = _mm256_set1_epi64x(static_cast<long long>(key));
+        for (size_t i = 0; i < size; i += 4) {
+            const __m256i t = _mm256_load_si256(reinterpret_cast<const __m256i*>(&tags_[i]));
+            const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, k)));
+            if (mask != 0) {
+                return hit(static_cast<int>(i) + __builtin_ctz(mask));
+            }
+        }
+#elif defined(__SSE4_1__)
+        const __m128i k = _mm_set1_epi64x(static_cast<long long>(key));
+        for (size_t i = 0; i < size; i += 2) {
+            const __m128i t = _mm_load_si128(reinterpret_cast<const __m128i*>(&tags_[i]));
+            const int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(t, k)));
+            if (mask != 0) {
+                return hit(static_cast<int>(i) + __builtin_ctz(mask));
+            }
+        }
+#else
+        for (size_t i = 0; i < size; ++i) {
+            if (tags_[i] == key) {
+                return hit(static_cast<int>(i));
+            }
+        }
+#endif
+        return -1;
+    }
+
+    void count_miss() { ++stats_.misses; }
+
+    pa_t pa(int slot, va_t va) const {
+        return page_pa_[slot] | (va & 0xFFF);
+    }
+
+    // nullptr when the page is not backed by guest memory
+    uint8_t* host(int slot, va_t va) const {
+        return page_host_[slot] ? page_host_[slot] + (va & 0xFFF) : nullptr;
+    }
+
+    // Caches the 4 KiB page of va out of a main TLB entry
+    void insert(va_t va, const TLBEntry& e) {
+        const va_t offset = va & (e.page_size - 1) & ~va_t{0xFFF};
+        const size_t slot = next_;
+        next_ = (next_ + 1) % size;
+        tags_[slot] = va >> 12;
+        page_pa_[slot] = (e.ppn << 12) + offset;
+        page_host_[slot] = e.host ? e.host + offset : nullptr;
+    }
+
+    void flush() {
+        tags_.fill(invalid_tag);
+    }
+
+    const TLBStats& stats() const { return stats_; }
+
+private:
+    // No va has all 64 bits of its page number set
+    static constexpr uint64_t invalid_tag = ~uint64_t{0};
+
+    int hit(int slot) {
+        ++stats_.hits;
+        return slot;
+    }
+
+    alignas(32) std::array<uint64_t, size> tags_;
+    std::array<pa_t, size> page_pa_{};
+    std::array<uint8_t*, size> page_host_{};
+    size_t next_ = 0;
+    uint16_t asid_ = 0;
+    TLBStats stats_;
+};
@@ -30,7 +30,8 @@ constexpr pa_t PPN_MASK = 0x1FF;
 
 TranslateResult MMU::translate_generic(va_t va,
                                  AccessType type,
-                                 const HartContext ctx)
+                                 const HartContext ctx,
+                                 size_t size)
 {
     using EC = ExceptionCause;
 
@@ -38,7 +39,7 @@ TranslateResult MMU::translate_generic(va_t va,
     const uint64_t SV39_MODE = 8;
 
     if (ctx.mode == 0) {
-        return { .pa = va, .e = Exception{EC::None} };
+        return translate_bare(va, size, type);
     }
     if (ctx.mode != SV39_MODE) {
         return { .pa = 0, .e = Exception{EC::PageFault} };
@@ -53,18 +54,28 @@ TranslateResult MMU::translate_generic(va_t va,
     
     pa_t pte = 0;
     int level = LEVELS - 1;
+    bool global = false;    // G on any level of the walk covers the whole subtree
+    pa_t start = ctx.root_table;
+
+    int cached_level = 0;
+    if (const auto* cached = pwc_.lookup(ctx.root_table, va, cached_level)) {
+        level = cached_level;
+        start = cached->table;
+        global = cached->global;
+    }
 
-    for (pa_t base = ctx.root_table; 
+    for (pa_t base = start; 
             true; 
             base = (pte >> 10) * PAGESIZE) 
         {
         pa_t pte_addr = base + vpn[level] * PTESIZE;
-        pte = mem_load(pte_addr, sizeof(pa_t));
+        pte = mem_load<sizeof(pa_t)>(pte_addr);
 
         flag_t V = pte & PTE_V;
         flag_t R = pte & PTE_R;
         flag_t W = pte & PTE_W;
         flag_t X = pte & PTE_X;
+        global |= (pte & PTE_G) != 0;
 
         // TODO Check Other flags
 
@@ -80,6 +91,7 @@ TranslateResult MMU::translate_generic(va_t va,
         if (--level < 0) {
             return { .pa = 0, .e = Exception{EC::PageFault}, .faulting_addr=va, .access= type};
         }
+        pwc_.insert(ctx.root_table, va, level, (pte >> 10) * PAGESIZE, global);
     }
 
     pa_t ppn_all = (pte >> 10);
@@ -99,6 +111,9 @@ TranslateResult MMU::translate_generic(va_t va,
         (final_ppn0);
 
     pa_t pa64 = (ppn_combined << 12) | page_offset;
+    if (!is_backed(pa64, size)) {
+        return { .pa = 0, .e = Exception{EC::AccessFault}, .faulting_addr=va, .access= type};
+    }
 
     // Update TLB
     uint32_t page_size;
@@ -108,10 +123,16 @@ TranslateResult MMU::translate_generic(va_t va,
         default: page_size = 1u << 12; break; // 4KB
     }
 
-    switch (type) {
-        case AccessType::Fetch:   itlb_.insert(va, pa64, page_size); break;
-        case AccessType::Load:  dtlb_r_.insert(va, pa64, page_size); break;
-        case AccessType::Store: dtlb_w_.insert(va, pa64, page_size); break;
+    // A page running past the end of RAM would let later hits reach
+    // addresses that were never checked, so it is walked every time
+    const pa_t base = pa64 & ~static_cast<pa_t>(page_size - 1);
+    if (base + page_size <= mem_.size() || (page_size == PAGESIZE && bus_.find(base))) {
+        uint8_t* host = host_page(pa64, page_size);
+        switch (type) {
+            case AccessType::Fetch:   itlb_.insert(va, pa64, page_size, ctx.asid, global, host); break;
+            case AccessType::Load:  dtlb_r_.insert(va, pa64, page_size, ctx.asid, global, host); break;
+            case AccessType::Store: dtlb_w_.insert(va, pa64, page_size, ctx.asid, global, host); break;
+        }
     }
 
     return {
@@ -119,3 +140,12 @@ TranslateResult MMU::translate_generic(va_t va,
         .e  = Exception{EC::None}
     };
 }
+
+// Host address of pa if its whole page is backed by guest RAM
+uint8_t* MMU::host_page(pa_t pa, uint32_t page_size) {
+    const pa_t base = pa & ~static_cast<pa_t>(page_size - 1);
+    if (base + page_size > mem_.size() || bus_.overlaps(base, page_size)) {
+        return nullptr;
+    }
+    return mem_.data() + pa;
+}
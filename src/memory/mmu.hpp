@@ -1,8 +1,12 @@
 #pragma once
+#include <algorithm>
 #include <sstream>
 #include <hart/hart_common.hpp>
 #include "memory.hpp"
 #include "tlb.hpp"
+#include "page_walk_cache.hpp"
+#include "micro_tlb.hpp"
+#include "bus.hpp"
 
 
 // MUST BE IN SYNC WITH memory.cpp !!!
@@ -15,10 +19,10 @@ constexpr flag_t PTE_V = 1 << 0;
 constexpr flag_t PTE_R = 1 << 1;
 constexpr flag_t PTE_W = 1 << 2;
 constexpr flag_t PTE_X = 1 << 3;
+constexpr flag_t PTE_G = 1 << 5;
 
 // TODO to be added
 // constexpr uint64_t PTE_U = 1 << 4;
-// constexpr uint64_t PTE_G = 1 << 5;
 // constexpr uint64_t PTE_A = 1 << 6;
 // constexpr uint64_t PTE_D = 1 << 7;
 
@@ -28,10 +32,9 @@ struct HartContext {
     pa_t root_table;
     reg_t mode;
     PrivilegeMode prv;
+    uint16_t asid;
 };
 
-constexpr int TLB_SIZE = 64;
-
 struct TranslateResult {
     pa_t pa;
     Exception e;
@@ -64,47 +67,184 @@ struct TranslateResult {
 
 class MMU {
 public:
-    explicit MMU(Memory &m) : 
+    explicit MMU(Memory &m, const TLBConfig& itlb = {}, const TLBConfig& dtlb = {}) :
         mem_(m),
-        itlb_  (TLB_SIZE),
-        dtlb_r_(TLB_SIZE),
-        dtlb_w_(TLB_SIZE) 
+        direct_limit_(m.size()),
+        itlb_  (itlb),
+        dtlb_r_(dtlb),
+        dtlb_w_(dtlb) 
         {}
 
     uint8_t* get_raw_ptr() { return mem_.data(); }
     size_t get_capacity() const { return mem_.size(); }
 
+    // size is the width of the access at va; all of it has to be backed
     template<AccessType type>
-    TranslateResult translate(va_t va, const HartContext ctx) {
+    TranslateResult translate(va_t va, const HartContext ctx, size_t size = 1) {
         
         if (ctx.mode == 0) {
-            return { .pa = va, .e = Exception{ExceptionCause::None} };
+            return translate_bare(va, size, type);
         }
         
-        const TLBEntry* hit = nullptr;
-        if constexpr (type == AccessType::Fetch)
-            hit = itlb_.lookup(va);
-        else if constexpr (type == AccessType::Load)
-            hit = dtlb_r_.lookup(va);
-        else if constexpr (type == AccessType::Store)
-            hit = dtlb_w_.lookup(va);
+        MicroTLB& micro = micro_tlb<type>();
+        if (const int slot = micro.lookup(va, ctx.asid); slot >= 0) {
+            return translate_hit(va, micro.pa(slot, va), size, type);
+        }
 
-        if (hit) {
+        if (const TLBEntry* hit = tlb<type>().lookup(va, ctx.asid)) {
+            micro.insert(va, *hit);
             pa_t pa = (hit->ppn << 12) | (va & (hit->page_size - 1));
-            return {.pa = pa, .e = Exception{ExceptionCause::None}};
+            return translate_hit(va, pa, size, type);
         }
 
-        return translate_generic(va, type, ctx);
+        return translate_generic(va, type, ctx, size);
+    }
+
+    // Host address of the size bytes at va when they translate without a
+    // page walk: with paging off when they are RAM below every device, on a TLB hit within one
+    // page otherwise. nullptr sends the caller to translate(), which walks,
+    // refills the TLB and reports faults.
+    template<AccessType type>
+    uint8_t* host_ptr(va_t va, size_t size, const HartContext& ctx) {
+        if (ctx.mode == 0) {
+            if (static_cast<unsigned __int128>(va) + size > direct_limit_) {
+                return nullptr;
+            }
+            return mem_.data() + va;
+        }
+        // The next page may map anywhere
+        if ((va & (PAGESIZE - 1)) + size > PAGESIZE) {
+            return nullptr;
+        }
+
+        // Misses are left for translate() to count
+        MicroTLB& micro = micro_tlb<type>();
+        if (const int slot = micro.probe(va, ctx.asid); slot >= 0) {
+            return micro.host(slot, va);
+        }
+
+        const TLBEntry* hit = tlb<type>().probe(va, ctx.asid);
+        if (!hit || !hit->host) {
+            return nullptr;
+        }
+        micro.count_miss();
+        micro.insert(va, *hit);
+        return hit->host + (va & (hit->page_size - 1));
     }
     
-    reg_t mem_load(pa_t pa, int size) const {return mem_.read(pa, size); };
-    void mem_store(pa_t pa, reg_t value, int size) { return mem_.write(pa, value, size); };
+    // Physical accesses; device pages go to the device, the rest to RAM
+    reg_t mem_load(pa_t pa, int size) const {
+        if (const Bus::Region* r = bus_.find(pa))
+            return r->device->read(pa - r->base, size);
+        return mem_.read(pa, size);
+    }
+    void mem_store(pa_t pa, reg_t value, int size) {
+        if (const Bus::Region* r = bus_.find(pa))
+            return r->device->write(pa - r->base, value, size);
+        return mem_.write(pa, value, size);
+    }
+
+    template<int N>
+    mem_word_t<N> mem_load(pa_t pa) const {
+        if (const Bus::Region* r = bus_.find(pa))
+            return static_cast<mem_word_t<N>>(r->device->read(pa - r->base, N));
+        return mem_.read<N>(pa);
+    }
+    template<int N>
+    void mem_store(pa_t pa, mem_word_t<N> value) {
+        if (const Bus::Region* r = bus_.find(pa))
+            return r->device->write(pa - r->base, value, N);
+        mem_.write<N>(pa, value);
+    }
+
+    // Maps a device at [base, base + size); its pages never get a host
+    // pointer, so every access to them reaches the device
+    void add_device(pa_t base, size_t size, std::shared_ptr<MMIODevice> device) {
+        bus_.add_device(base, size, std::move(device));
+        direct_limit_ = std::min<uint64_t>(mem_.size(), bus_.hull_lo());
+        sfence_vma(std::nullopt, std::nullopt);
+    }
+    bool has_devices() const { return !bus_.empty(); }
+    const Bus& bus() const { return bus_; }
+    bool is_device_range(pa_t base, size_t size) const { return bus_.overlaps(base, size); }
+
+    // SFENCE.VMA over every TLB; an empty va or asid widens the fence.
+    // Cached non-leaf PTEs are dropped by any fence.
+    void sfence_vma(std::optional<va_t> va, std::optional<uint16_t> asid) {
+        itlb_.flush(va, asid);
+        dtlb_r_.flush(va, asid);
+        dtlb_w_.flush(va, asid);
+        pwc_.flush();
+        itlb_micro_.flush();
+        dtlb_r_micro_.flush();
+        dtlb_w_micro_.flush();
+    }
+
+    const TLB& itlb() const { return itlb_; }
+    const TLB& dtlb_r() const { return dtlb_r_; }
+    const TLB& dtlb_w() const { return dtlb_w_; }
+    const PageWalkCache& pwc() const { return pwc_; }
+    const MicroTLB& itlb_micro() const { return itlb_micro_; }
+    const MicroTLB& dtlb_r_micro() const { return dtlb_r_micro_; }
+    const MicroTLB& dtlb_w_micro() const { return dtlb_w_micro_; }
 
 private:
     Memory &mem_;
-    TranslateResult translate_generic(va_t va, AccessType type, const HartContext ctx);
+    Bus bus_;
+    // RAM below every device; paging-off accesses under it need no bus lookup
+    uint64_t direct_limit_;
+    TranslateResult translate_generic(va_t va, AccessType type, const HartContext ctx, size_t size);
+
+    // Whether [pa, pa + size) is RAM, or starts in a device
+    bool is_backed(pa_t pa, size_t size) const {
+        return static_cast<unsigned __int128>(pa) + size <= mem_.size() || bus_.find(pa);
+    }
+
+    // Paging off: the address is physical and has to be RAM or a device
+    TranslateResult translate_bare(va_t va, size_t size, AccessType type) const {
+        if (!is_backed(va, size)) {
+            return {.pa = 0, .e = Exception{ExceptionCause::AccessFault}, .faulting_addr = va, .access = type};
+        }
+        return {.pa = va, .e = Exception{ExceptionCause::None}};
+    }
+
+    // Cached pages are wholly backed, so only an access running off the end
+    // of its page needs another check
+    TranslateResult translate_hit(va_t va, pa_t pa, size_t size, AccessType type) const {
+        if ((va & (PAGESIZE - 1)) + size > PAGESIZE && !is_backed(pa, size)) {
+            return {.pa = 0, .e = Exception{ExceptionCause::AccessFault}, .faulting_addr = va, .access = type};
+        }
+        return {.pa = pa, .e = Exception{ExceptionCause::None}};
+    }
+    uint8_t* host_page(pa_t pa, uint32_t page_size);
 
     TLB itlb_;
     TLB dtlb_r_;
     TLB dtlb_w_;
+    PageWalkCache pwc_;
+
+    // Looked up before the TLB of the same access type
+    MicroTLB itlb_micro_;
+    MicroTLB dtlb_r_micro_;
+    MicroTLB dtlb_w_micro_;
+
+    template<AccessType type>
+    TLB& tlb() {
+        if constexpr (type == AccessType::Fetch)
+            return itlb_;
+        else if constexpr (type == AccessType::Load)
+            return dtlb_r_;
+        else
+            return dtlb_w_;
+    }
+
+    template<AccessType type>
+    MicroTLB& micro_tlb() {
+        if constexpr (type == AccessType::Fetch)
+            return itlb_micro_;
+        else if constexpr (type == AccessType::Load)
+            return dtlb_r_micro_;
+        else
+            return dtlb_w_micro_;
+    }
 };
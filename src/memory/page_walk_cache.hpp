@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include "tlb.hpp"
+
+// Non-leaf PTEs of recent Sv39 walks. Level 1 holds the table a walk
+// reaches through VPN[2], level 0 the one it reaches through VPN[2..1], so
+// a TLB miss next to a recently walked page starts at the last level and
+// reads a single PTE. Entries are tagged with the root table, so they stay
+// valid across address-space switches; any SFENCE.VMA drops them all.
+class PageWalkCache {
+public:
+    static constexpr size_t entries_per_level = 16;
+
+    struct Entry {
+        pa_t root;
+        va_t prefix;    // va bits above the level's table index
+        pa_t table;     // physical address of the level's page table
+        bool global;    // a PTE above the table had G set
+        bool valid;
+    };
+
+    // Deepest cached table on the way to va, with its level (1 or 0)
+    const Entry* lookup(pa_t root, va_t va, int& level) {
+        for (level = 0; level < 2; ++level) {
+            const Entry& e = slot(va, level);
+            if (e.valid && e.root == root && e.prefix == prefix(va, level)) {
+                ++stats_.hits;
+                return &e;
+            }
+        }
+        ++stats_.misses;
+        return nullptr;
+    }
+
+    void insert(pa_t root, va_t va, int level, pa_t table, bool global) {
+        slot(va, level) = Entry{
+            .root = root,
+            .prefix = prefix(va, level),
+            .table = table,
+            .global = global,
+            .valid = true
+        };
+    }
+
+    void flush() {
+        for (auto &level : entries_)
+            for (auto &e : level)
+                e.valid = false;
+    }
+
+    const TLBStats& stats() const { return stats_; }
+
+private:
+    static va_t prefix(va_t va, int level) {
+        return va >> (12 + 9 * (level + 1));
+    }
+
+    Entry& slot(va_t va, int level) {
+        return entries_[level][prefix(va, level) & (entries_per_level - 1)];
+    }
+
+    std::array<std::array<Entry, entries_per_level>, 2> entries_{};
+    TLBStats stats_;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <optional>
 #include <vector>
+#include <stdexcept>
 #include <hart/hart_common.hpp>
 
 struct TLBEntry {
@@ -8,8 +10,11 @@ struct TLBEntry {
     pa_t ppn;       // Physical page number
     uint32_t page_size; // 4k / 2M / 1G
     bool     valid;
+    uint16_t asid;      // satp.ASID the translation was made under
+    bool     global;    // PTE.G: valid in every address space
+    uint8_t* host;      // host address of the page, nullptr if not backed
 
-    bool match(va_t va) const {
+    bool covers(va_t va) const {
         if (!valid) return false;
 
         va_t va_mask = ~(page_size - 1);
@@ -17,6 +22,10 @@ struct TLBEntry {
 
         return va_tag == tag;
     }
+
+    bool match(va_t va, uint16_t cur_asid) const {
+        return covers(va) && (global || asid == cur_asid);
+    }
 };
 
 inline size_t tlb_hash(va_t va, size_t size_mask) {
@@ -24,27 +33,75 @@ inline size_t tlb_hash(va_t va, size_t size_mask) {
     return vpn & size_mask;
 }
 
+enum class TLBReplacement {
+    LRU,
+    RoundRobin
+};
+
+struct TLBConfig {
+    size_t entries = 64;
+    size_t ways = 4;     // 1 for direct-mapped, entries for fully associative
+    TLBReplacement replacement = TLBReplacement::LRU;
+};
+
+struct TLBStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
 
+// Set-associative TLB: the low VPN bits select a set of `ways` entries.
 class TLB {
 public:
-    explicit TLB(size_t size)
-        : size_(size), mask_(size - 1), entries_(size) {}
+    explicit TLB(const TLBConfig& config)
+        : ways_(config.ways),
+          set_mask_(config.ways == 0 ? 0 : config.entries / config.ways - 1),
+          replacement_(config.replacement),
+          entries_(config.entries, TLBEntry{0, 0, 0, false, 0, false, nullptr}),
+          last_use_(config.entries, 0),
+          next_victim_(config.ways == 0 ? 0 : config.entries / config.ways, 0) {
+        const size_t sets = set_mask_ + 1;
+        if (ways_ == 0 || config.entries < ways_ || config.entries % ways_ != 0 || (sets & (sets - 1)) != 0) {
+            throw std::invalid_argument("TLB entries must be a power-of-two multiple of ways");
+        }
+    }
 
-    const TLBEntry* lookup(va_t va) const {
-        const auto &e = entries_[tlb_hash(va, mask_)];
-        return e.match(va) ? &e : nullptr;
+    explicit TLB(size_t size) : TLB(TLBConfig{size, 1, TLBReplacement::LRU}) {}
+
+    const TLBEntry* lookup(va_t va, uint16_t asid) {
+        const TLBEntry* hit = probe(va, asid);
+        if (!hit)
+            ++stats_.misses;
+        return hit;
     }
 
-    void insert(va_t va, pa_t pa, uint32_t page_size) {
-        va_t vpn = va >> 12;
+    // lookup that leaves the miss to be counted by the lookup that follows
+    const TLBEntry* probe(va_t va, uint16_t asid) {
+        const size_t base = tlb_hash(va, set_mask_) * ways_;
+        for (size_t i = base; i < base + ways_; ++i) {
+            if (entries_[i].match(va, asid)) {
+                ++stats_.hits;
+                last_use_[i] = ++clock_;
+                return &entries_[i];
+            }
+        }
+        return nullptr;
+    }
 
-        size_t idx = tlb_hash(va, mask_);
+    // pa and host are those of va; the entry keeps the page's base
+    void insert(va_t va, pa_t pa, uint32_t page_size, uint16_t asid, bool global, uint8_t* host) {
+        const size_t set = tlb_hash(va, set_mask_);
+        const size_t idx = set * ways_ + victim(set);
+        const va_t offset = va & (page_size - 1);
         entries_[idx] = TLBEntry{
             .tag = (va & ~(page_size - 1)) >> 12,
-            .ppn = pa >> 12,
+            .ppn = (pa - offset) >> 12,
             .page_size = page_size,
-            .valid = true
+            .valid = true,
+            .asid = asid,
+            .global = global,
+            .host = host ? host - offset : nullptr
         };
+        last_use_[idx] = ++clock_;
     }
 
     void flush() {
@@ -52,8 +109,50 @@ public:
             e.valid = false;
     }
 
+    // SFENCE.VMA: drops translations of va (every address when empty) made
+    // under asid (every address space when empty). Global entries survive
+    // an ASID-specific fence.
+    void flush(std::optional<va_t> va, std::optional<uint16_t> asid) {
+        for (auto &e : entries_) {
+            if (va && !e.covers(*va))
+                continue;
+            if (asid && (e.global || e.asid != *asid))
+                continue;
+            e.valid = false;
+        }
+    }
+
+    const TLBStats& stats() const { return stats_; }
+
 private:
-    size_t size_;
-    size_t mask_;
+    // Way to refill in set: a free one if any, else the policy's choice
+    size_t victim(size_t set) {
+        const size_t base = set * ways_;
+        for (size_t w = 0; w < ways_; ++w) {
+            if (!entries_[base + w].valid) {
+                return w;
+            }
+        }
+        if (replacement_ == TLBReplacement::RoundRobin) {
+            const size_t w = next_victim_[set];
+            next_victim_[set] = (w + 1 == ways_) ? 0 : w + 1;
+            return w;
+        }
+        size_t lru = 0;
+        for (size_t w = 1; w < ways_; ++w) {
+            if (last_use_[base + w] < last_use_[base + lru]) {
+                lru = w;
+            }
+        }
+        return lru;
+    }
+
+    size_t ways_;
+    size_t set_mask_;
+    TLBReplacement replacement_;
     std::vector<TLBEntry> entries_;
+    std::vector<uint64_t> last_use_;        // LRU stamps, parallel to entries_
+    std::vector<size_t> next_victim_;       // round-robin pointer per set
+    uint64_t clock_ = 0;
+    TLBStats stats_;
 };